@@ -11,6 +11,24 @@ void CMatView::SetImage(cv::Mat const& mat)
 }
 
 
+void CMatView::SetImage(cv::Mat const& mat, std::vector<cv::Rect> const& dirtyRects)
+{
+    if (mat.size() != m_mat.size())
+    {
+        SetImage(mat);
+        return;
+    }
+
+    m_mat = mat;
+
+    for (auto const& rc : dirtyRects)
+    {
+        CRect rect(rc.x, rc.y, rc.x + rc.width, rc.y + rc.height);
+        InvalidateRect(&rect, FALSE);
+    }
+}
+
+
 BEGIN_MESSAGE_MAP(CMatView, CStatic)
     ON_WM_ERASEBKGND()
     ON_WM_PAINT()
@@ -42,14 +60,21 @@ void CMatView::OnPaint()
     {
         CPaintDC dc(this);
 
+        // only copy the rows that need repainting; the DC clips to the invalid region within them
+        CRect paintRect(dc.m_ps.rcPaint);
+        int top = max(0, (int)paintRect.top);
+        int bottom = min(m_mat.rows, (int)paintRect.bottom);
+        if (bottom <= top)
+            return;
+
         BITMAPINFOHEADER bi = { sizeof(bi) };
         bi.biWidth = m_mat.cols;
-        bi.biHeight = -m_mat.rows;
+        bi.biHeight = -(bottom - top);
         bi.biBitCount = (WORD)(m_mat.channels() * 8);
         bi.biPlanes = 1;
 
-        SetDIBitsToDevice(dc, 0, 0, m_mat.cols, m_mat.rows, 0, 0, 0, m_mat.rows,
-            m_mat.data, (BITMAPINFO*)&bi, DIB_RGB_COLORS);
+        SetDIBitsToDevice(dc, 0, top, m_mat.cols, bottom - top, 0, 0, 0, bottom - top,
+            m_mat.ptr(top), (BITMAPINFO*)&bi, DIB_RGB_COLORS);
 
         return;
 
@@ -9,6 +9,9 @@ class CMatView : public CStatic
 public:
 
     void SetImage(cv::Mat const& mat);
+    // repaints only {dirtyRects} (image coordinates) unless the image size changed.
+    // {mat} must otherwise match the image last shown
+    void SetImage(cv::Mat const& mat, std::vector<cv::Rect> const& dirtyRects);
 
     DECLARE_MESSAGE_MAP()
     HBRUSH CtlColor(CDC* pDC, UINT nCtlColor);
@@ -219,7 +219,7 @@ BOOL CThicketDlg::OnInitDialog()
 	m_transformsList.InsertColumn(3, L"key", LVCFMT_LEFT, 100);
 	m_transformsList.InsertColumn(4, L"color", LVCFMT_LEFT | LVCFMT_FILL, 100);
 
-	demo.m_progressCallback = [&](int w, int l) {
+	demo.m_progressCallback = [&](int w, int l, std::vector<cv::Rect> const &) {
 		::PostMessage(m_hWnd, WM_RUN_PROGRESS, w, l);
 		return 0; };
 
@@ -331,9 +331,22 @@ LRESULT CThicketDlg::OnRunProgress(WPARAM w, LPARAM l)
 		if (demo.m_restart) str += " restart";
 		if (demo.m_stepping) str += " step";
 		if (demo.isWorkerTaskRunning()) str += " RUNNING";
-		SetDlgItemText(IDC_STATUS, str);
 
-		m_matView.SetImage(demo.canvas.image);
+		// show the latest completed frame. if frames were skipped, its own dirty regions aren't enough
+		bool isNew;
+		auto const &frame = demo.snapshots.acquire(&isNew);
+		if (isNew && !frame.image.empty())
+		{
+			if (frame.sequence == m_displayedSequence + 1)
+				m_matView.SetImage(frame.image, frame.dirtyRects);
+			else
+				m_matView.SetImage(frame.image);
+			m_displayedSequence = frame.sequence;
+		}
+		if (!frame.image.empty())
+			str.AppendFormat(L" (%.0fms)", 1000.0 * SnapshotBuffer::age(frame));
+
+		SetDlgItemText(IDC_STATUS, str);
 	}
 	else
 	{
@@ -42,6 +42,9 @@ protected:
 
 	CMatView m_matView;
 
+	// sequence number of the snapshot frame on screen
+	uint64_t m_displayedSequence = 0;
+
 	afx_msg LRESULT OnRunProgress(WPARAM, LPARAM);
 
 	// Generated message map functions
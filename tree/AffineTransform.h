@@ -0,0 +1,140 @@
+#pragma once
+
+
+#include "util.h"
+#include <opencv2/core/core.hpp>
+#include <cmath>
+#include <vector>
+
+
+//  2D affine transform, stored as the top two rows of its 3x3 matrix (the bottom row is always 0 0 1),
+//  with the determinant of its linear part kept alongside, so ordering nodes by size doesn't recompute it.
+//  Indexes like the 3x3 matrix, and converts to and from cv::Matx where OpenCV is called.
+template<typename _Tp>
+class AffineTransform_
+{
+    template<typename> friend class AffineTransform_;
+
+    _Tp a[6];       // row-major: a00 a01 a02, a10 a11 a12
+    _Tp d;          // a00 * a11 - a01 * a10
+
+    AffineTransform_(_Tp a00, _Tp a01, _Tp a02, _Tp a10, _Tp a11, _Tp a12, _Tp det_)
+        : a{ a00, a01, a02, a10, a11, a12 }, d(det_) {}
+
+public:
+    AffineTransform_()
+        : a{ 1, 0, 0, 0, 1, 0 }, d(1) {}
+
+    AffineTransform_(_Tp a00, _Tp a01, _Tp a02, _Tp a10, _Tp a11, _Tp a12)
+        : a{ a00, a01, a02, a10, a11, a12 }, d(a00 * a11 - a01 * a10) {}
+
+    //  from the top two rows of {m}
+    template<typename _Tp2>
+    AffineTransform_(cv::Matx<_Tp2, 3, 3> const &m)
+        : AffineTransform_((_Tp)m(0, 0), (_Tp)m(0, 1), (_Tp)m(0, 2), (_Tp)m(1, 0), (_Tp)m(1, 1), (_Tp)m(1, 2)) {}
+
+    template<typename _Tp2>
+    AffineTransform_(cv::Matx<_Tp2, 2, 3> const &m)
+        : AffineTransform_((_Tp)m(0, 0), (_Tp)m(0, 1), (_Tp)m(0, 2), (_Tp)m(1, 0), (_Tp)m(1, 1), (_Tp)m(1, 2)) {}
+
+    //  from a transform of another precision
+    template<typename _Tp2>
+    explicit AffineTransform_(AffineTransform_<_Tp2> const &t)
+        : AffineTransform_((_Tp)t.a[0], (_Tp)t.a[1], (_Tp)t.a[2], (_Tp)t.a[3], (_Tp)t.a[4], (_Tp)t.a[5]) {}
+
+    static AffineTransform_ eye() { return AffineTransform_(); }
+
+    //  element of the 3x3 matrix
+    _Tp operator()(int i, int j) const { return (i < 2) ? a[3 * i + j] : (_Tp)(j == 2 ? 1 : 0); }
+
+    _Tp det() const { return d; }
+
+    //  linear scale factor: the square root of the area scale
+    _Tp scale() const { return std::sqrt(std::abs(d)); }
+
+    operator cv::Matx<_Tp, 3, 3>() const
+    {
+        return cv::Matx<_Tp, 3, 3>(
+            a[0], a[1], a[2],
+            a[3], a[4], a[5],
+            0, 0, 1);
+    }
+
+    cv::Matx<_Tp, 2, 3> matx23() const
+    {
+        return cv::Matx<_Tp, 2, 3>(a[0], a[1], a[2], a[3], a[4], a[5]);
+    }
+
+    //  this transform applied after {t}: 12 multiply-adds, against 27 for 3x3 matrices.
+    //  The determinant composes as a product.
+    AffineTransform_ operator*(AffineTransform_ const &t) const
+    {
+        return AffineTransform_(
+            a[0] * t.a[0] + a[1] * t.a[3], a[0] * t.a[1] + a[1] * t.a[4], a[0] * t.a[2] + a[1] * t.a[5] + a[2],
+            a[3] * t.a[0] + a[4] * t.a[3], a[3] * t.a[1] + a[4] * t.a[4], a[3] * t.a[2] + a[4] * t.a[5] + a[5],
+            d * t.d);
+    }
+
+    //  {m} must be affine
+    AffineTransform_ operator*(cv::Matx<_Tp, 3, 3> const &m) const
+    {
+        return *this * AffineTransform_(m);
+    }
+
+    friend cv::Matx<_Tp, 3, 3> operator*(cv::Matx<_Tp, 3, 3> const &m, AffineTransform_ const &t)
+    {
+        return m * cv::Matx<_Tp, 3, 3>(t);
+    }
+
+    cv::Point_<_Tp> operator*(cv::Point_<_Tp> const &p) const
+    {
+        return cv::Point_<_Tp>(a[0] * p.x + a[1] * p.y + a[2], a[3] * p.x + a[4] * p.y + a[5]);
+    }
+
+    //  inverse; identity scaled by zero if singular, as cv::Matx::inv returns
+    AffineTransform_ inv() const
+    {
+        if (d == 0)
+            return AffineTransform_(0, 0, 0, 0, 0, 0, 0);
+        _Tp id = 1 / d;
+        _Tp b00 = a[4] * id, b01 = -a[1] * id;
+        _Tp b10 = -a[3] * id, b11 = a[0] * id;
+        return AffineTransform_(
+            b00, b01, -(b00 * a[2] + b01 * a[5]),
+            b10, b11, -(b10 * a[2] + b11 * a[5]),
+            id);
+    }
+};
+
+typedef AffineTransform_<float> AffineTransform;
+
+//  Precision nodes' global transforms are composed in. Over tens of generations, float products drift
+//  enough for polygons to miss their edges; define QTREE_DOUBLE_PRECISION to compose them in double.
+//  Points are still float: only the accumulated transforms, and the per-generation transforms
+//  they're composed of (NodeMatx33), gain precision.
+#ifdef QTREE_DOUBLE_PRECISION
+typedef AffineTransform_<double> NodeTransform;
+typedef cv::Matx33d NodeMatx33;
+#else
+typedef AffineTransform_<float> NodeTransform;
+typedef cv::Matx33f NodeMatx33;
+#endif
+
+
+namespace util
+{
+    namespace polygon
+    {
+        //  maps polygon points through {t}, in {t}'s precision; as transform() for 3x3 matrices
+        template<typename _Tp, typename _Tt>
+        void transform(std::vector<cv::Point_<_Tp> > const &src, std::vector<cv::Point_<_Tp> > &dst, AffineTransform_<_Tt> const &t)
+        {
+            dst.resize(src.size());
+            for (size_t i = 0; i < src.size(); ++i)
+            {
+                cv::Point_<_Tt> p = t * cv::Point_<_Tt>((_Tt)src[i].x, (_Tt)src[i].y);
+                dst[i] = cv::Point_<_Tp>((_Tp)p.x, (_Tp)p.y);
+            }
+        }
+    }
+}
@@ -4,6 +4,8 @@
 #include "util.h"
 #include <nlohmann/json.hpp>
 #include <opencv2/core/core.hpp>
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 
 
@@ -13,35 +15,77 @@ inline void to_json(json& j, class ColorTransform const& t);
 inline void from_json(json const& j, class ColorTransform& t);
 
 
+//  Space a color's components are in. BGR and HLS components are as util::bgr2hls/hls2bgr use them
+enum class ColorSpace { BGR, HLS };
+
+
 class ColorTransform
 {
 public:
+    //  What the transform does, set by the static initializers (or classify() for raw matrices),
+    //  so apply(), serialization and interpolation needn't rediscover it.
+    //  The HLS kinds but GENERAL scale and offset h, l and s independently.
+    //  RGB kinds act on BGR colors directly, with no HLS conversion.
+    enum class Kind
+    {
+        IDENTITY,
+        HUE_SHIFT,          // h offset only
+        HLS_SINK,           // h, l, s all scaled by 1-a, toward a target
+        HLS_TRANSFORM,      // h, l, s each scaled and offset
+        GENERAL,            // any 4x4 matrix on HLS
+        RGB_SINK,           // b, g, r all scaled by 1-a, toward a target
+        RGB_TRANSFORM       // any 4x4 matrix on BGR
+    };
+
     cv::Matx<float, 4, 4> hls = hls.eye();
+    Kind kind = Kind::IDENTITY;
+    cv::Matx<float, 4, 4> bgr = bgr.eye();     // for the RGB kinds, in place of {hls}
 
     // static initializers
 
+    //  Moves colors {a} of the way to {color}, 0.0-1.0 BGR
     template<typename _Tp>
     static ColorTransform rgbSink(cv::Scalar_<_Tp> const& color, _Tp a)
     {
-        // todo
-        return ColorTransform{};
+        ColorTransform t;
+        if (!(a > 0))
+            return t;
+        t.bgr = cv::Matx<float, 4, 4>(
+            (float)(1 - a), 0, 0, (float)(a * color(0)),
+            0, (float)(1 - a), 0, (float)(a * color(1)),
+            0, 0, (float)(1 - a), (float)(a * color(2)),
+            0, 0, 0, 1);
+        t.kind = Kind::RGB_SINK;
+        return t;
     }
 
     template<typename _Tp>
     static ColorTransform rgbSink(cv::Matx<float, 4, 1> const& color, _Tp a)
     {
-        // todo
-        return ColorTransform{};
+        return rgbSink(cv::Scalar_<_Tp>((_Tp)color(0), (_Tp)color(1), (_Tp)color(2), (_Tp)color(3)), a);
+    }
+
+    //  Any affine transform of BGR colors
+    template<typename _Tp>
+    static ColorTransform rgbTransform(cv::Matx<_Tp, 4, 4> const& m)
+    {
+        ColorTransform t;
+        t.bgr = m;
+        t.kind = Kind::RGB_TRANSFORM;
+        return t;
     }
 
     template<typename _Tp>
     static ColorTransform hlsSink(_Tp b, _Tp g, _Tp r, _Tp a)
     {
+        // no pull toward the color: identity, with a matrix that agrees
+        if (!(a > 0))
+            return ColorTransform();
         return ColorTransform{ cv::Matx<_Tp, 4, 4>(
             1 - a, 0, 0, a * b,
             0, 1 - a, 0, a * g,
             0, 0, 1 - a, a * r,
-            0, 0, 0, 1) };
+            0, 0, 0, 1), Kind::HLS_SINK };
     }
 
     template<typename _Tp>
@@ -51,26 +95,110 @@ public:
             1, 0, 0, hueShift,
             0, 1, 0, 0,
             0, 0, 1, 0,
-            0, 0, 0, 1) };
+            0, 0, 0, 1), (hueShift != 0) ? Kind::HUE_SHIFT : Kind::IDENTITY };
     }
 
     // args: ha, hb, la, lb, sa, sb
     template<typename _Tp>
     static ColorTransform hlsTransform(std::vector<_Tp> const& args)
     {
-        return ColorTransform{ cv::Matx<_Tp, 4, 4>(
+        ColorTransform t{ cv::Matx<_Tp, 4, 4>(
             args[0], 0, 0, args[1],
             0, args[2], 0, args[3],
             0, 0, args[4], args[5],
             0, 0, 0, 1) };
+        t.classify();
+        return t;
+    }
+
+    //  Sets {kind} from the matrix, to within the tolerance util::approximatelyEqual uses.
+    //  For transforms built from a raw matrix; the static initializers set it themselves.
+    void classify()
+    {
+        auto approx = [](float v, float w) { return std::abs(v - w) < 0.0001f; };
+
+        kind = Kind::GENERAL;
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 3; ++j)
+                if (i != j && !approx(hls(i, j), 0.0f))
+                    return;
+        if (!approx(hls(3, 3), 1.0f))
+            return;
+
+        float d0 = hls(0, 0), d1 = hls(1, 1), d2 = hls(2, 2);
+        if (approx(d0, 1.0f) && approx(d1, 1.0f) && approx(d2, 1.0f) && approx(hls(1, 3), 0.0f) && approx(hls(2, 3), 0.0f))
+            kind = approx(hls(0, 3), 0.0f) ? Kind::IDENTITY : Kind::HUE_SHIFT;
+        else if (approx(d0, d1) && approx(d0, d2) && 1.0f - d0 > 0.0f)
+            kind = Kind::HLS_SINK;
+        else
+            kind = Kind::HLS_TRANSFORM;
     }
 
     // apply (todo: operator *, operator ())
 
+    //  Space apply() returns colors in
+    ColorSpace nativeSpace() const
+    {
+        return (kind == Kind::RGB_SINK || kind == Kind::RGB_TRANSFORM) ? ColorSpace::BGR : ColorSpace::HLS;
+    }
+
+    //  True if applying to a color in {space} converts it to another space first
+    bool converts(ColorSpace space) const
+    {
+        return (kind != Kind::IDENTITY && nativeSpace() != space);
+    }
+
     cv::Scalar apply(cv::Scalar const& color) const
     {
-        auto hlsColor = util::cvtColor(color, cv::ColorConversionCodes::COLOR_BGR2HLS);
-        return util::cvtColor(hls * hlsColor, cv::ColorConversionCodes::COLOR_HLS2BGR);
+        ColorSpace space = ColorSpace::BGR;
+        cv::Scalar result = apply(color, space);
+        return (space == ColorSpace::HLS) ? util::hls2bgr(result) : result;
+    }
+
+    //  Applies the transform to {color}, given in {space}, and returns the result in the transform's
+    //  native space (BGR for the RGB kinds, otherwise HLS), setting {space} to match. Converts only if
+    //  {color} isn't already in that space, so a lineage of same-space transforms converts once.
+    //  Identity leaves both untouched.
+    //  Hue is wrapped to 0-360, so it stays precise however many shifts accumulate.
+    cv::Scalar apply(cv::Scalar const& color, ColorSpace& space) const
+    {
+        if (kind == Kind::IDENTITY)
+            return color;
+
+        if (kind == Kind::RGB_SINK || kind == Kind::RGB_TRANSFORM)
+        {
+            cv::Scalar c = (space == ColorSpace::BGR) ? cv::Scalar(color(0), color(1), color(2), 1.0) : util::hls2bgr(color);
+            space = ColorSpace::BGR;
+            if (kind == Kind::RGB_TRANSFORM)
+                return bgr * c;
+            return cv::Scalar(
+                bgr(0, 0) * c(0) + bgr(0, 3),
+                bgr(1, 1) * c(1) + bgr(1, 3),
+                bgr(2, 2) * c(2) + bgr(2, 3), 1.0);
+        }
+
+        cv::Scalar c = (space == ColorSpace::HLS) ? cv::Scalar(color(0), color(1), color(2), 1.0) : util::bgr2hls(color);
+        space = ColorSpace::HLS;
+
+        switch (kind)
+        {
+        case Kind::HUE_SHIFT:
+            c(0) += hls(0, 3);
+            break;
+        case Kind::HLS_SINK:
+        case Kind::HLS_TRANSFORM:
+            c = cv::Scalar(
+                hls(0, 0) * c(0) + hls(0, 3),
+                hls(1, 1) * c(1) + hls(1, 3),
+                hls(2, 2) * c(2) + hls(2, 3), 1.0);
+            break;
+        default:
+            c = hls * c;
+            break;
+        }
+
+        c(0) -= 360.0 * std::floor(c(0) / 360.0);
+        return c;
     }
 
     // info
@@ -86,22 +214,19 @@ public:
     bool asHueShift(float& hueShift) const
     {
         hueShift = hls(0, 3);
-        std::vector<float> args{ 1.0f, hueShift, 1.0f, 0.0f, 1.0f, 0.0f };
-        auto test = ColorTransform::hlsTransform(args);
-        return util::approximatelyEqual(hls, test.hls);
+        return (kind == Kind::IDENTITY || kind == Kind::HUE_SHIFT);
     }
 
     //  Hls sink: subset of hlsTransform which when applied repeatedly converge to an hls value
     bool asHlsSink(float& h, float& l, float& s, float& a) const
     {
-        a = 1.0f - hls(0, 0);
-        if (!(a > 0.0f))
+        if (kind != Kind::HLS_SINK)
             return false;
+        a = 1.0f - hls(0, 0);
         h = hls(0, 3) / a;
         l = hls(1, 3) / a;
         s = hls(2, 3) / a;
-        auto test = ColorTransform::hlsSink(h, l, s, a);
-        return util::approximatelyEqual(hls, test.hls);
+        return true;
     }
 
     //  Hls transform: subset of 4x4 matrix with only 6 values set non-identy:
@@ -113,8 +238,19 @@ public:
             hls(1, 1), hls(1, 3),
             hls(2, 2), hls(2, 3)
         };
-        auto test = ColorTransform::hlsTransform(v);
-        return util::approximatelyEqual(hls, test.hls);
+        return (kind <= Kind::HLS_TRANSFORM);
+    }
+
+    //  Rgb sink: toward 0.0-1.0 BGR {b, g, r}, by {a}
+    bool asRgbSink(float& b, float& g, float& r, float& a) const
+    {
+        if (kind != Kind::RGB_SINK)
+            return false;
+        a = 1.0f - bgr(0, 0);
+        b = bgr(0, 3) / a;
+        g = bgr(1, 3) / a;
+        r = bgr(2, 3) / a;
+        return true;
     }
 
     //  Interpolate this transform with another
@@ -126,37 +262,42 @@ public:
         double b = 1.0 - f;
         float bh, bl, bs, ba;
         float fh, fl, fs, fa;
-        if (asHueShift(bh))
+        if (asHueShift(bh) && ct.asHueShift(fh))
         {
-            if (ct.asHueShift(fh))
-            {
-                *this = ColorTransform::hueShift(f * fh + b * bh);
-                return;
-            }
+            *this = ColorTransform::hueShift(f * fh + b * bh);
+            return;
         }
-        if (asHlsSink(bh, bl, bs, ba))
+        if (asHlsSink(bh, bl, bs, ba) && ct.asHlsSink(fh, fl, fs, fa))
         {
-            if (ct.asHlsSink(fh, fl, fs, fa))
-            {
-                *this = ColorTransform::hlsSink(f * fh + b * bh, f * fl + b * bl, f * fs + b * bs, f * fa + b * ba);
-                return;
-            }
+            *this = ColorTransform::hlsSink(f * fh + b * bh, f * fl + b * bl, f * fs + b * bs, f * fa + b * ba);
+            return;
         }
-        std::vector<float> bt;
-        if (asHlsTransform(bt))
+        float bb, bg, br;
+        float fb, fg, fr;
+        if (asRgbSink(bb, bg, br, ba) && ct.asRgbSink(fb, fg, fr, fa))
         {
-            std::vector<float> at;
-            if (ct.asHlsTransform(at))
-            {
-                // not quite perfect, because scaling factors are combined linearly
-                //*this = ColorTransform::hlsTransform(a * ah + b * bh, a * al + b * bl, a * as + b * bs);
-                hls = b * hls + f * ct.hls;
-                return;
-            }
+            *this = ColorTransform::rgbSink(cv::Scalar_<float>((float)(f * fb + b * bb), (float)(f * fg + b * bg), (float)(f * fr + b * br), 1.0f), (float)(f * fa + b * ba));
+            return;
         }
-        // catchall
+        bool rgb = (kind == Kind::RGB_SINK || kind == Kind::RGB_TRANSFORM);
+        bool ctRgb = (ct.kind == Kind::RGB_SINK || ct.kind == Kind::RGB_TRANSFORM);
+        if (rgb != ctRgb)
+        {
+            // spaces differ, and their matrices don't mix: take whichever is nearer
+            if (f >= 0.5)
+                *this = ct;
+            return;
+        }
+        if (rgb)
+        {
+            // either may be a sink, which is also an affine BGR transform
+            *this = ColorTransform::rgbTransform(cv::Matx<float, 4, 4>(b * bgr + f * ct.bgr));
+            return;
+        }
+        // hls transforms and the catchall:
         // not quite perfect, because scaling factors are combined linearly
         hls = b * hls + f * ct.hls;
+        classify();
     }
 };
 
@@ -166,7 +307,7 @@ public:
 inline void to_json(json& j, ColorTransform const& t)
 {
     // new form:
-    if (t.hls == t.hls.eye())
+    if (t.kind == ColorTransform::Kind::IDENTITY)
     {
         // "color": "I"
         j = "I";
@@ -191,6 +332,20 @@ inline void to_json(json& j, ColorTransform const& t)
         return;
     }
 
+    float b, g, r;
+    if (t.asRgbSink(b, g, r, a))
+    {
+        // components in RGB order, as in the name
+        j = json{ {"rgbSink", json{r, g, b, a} } };
+        return;
+    }
+    if (t.kind == ColorTransform::Kind::RGB_TRANSFORM)
+    {
+        // 4x4 array acting on BGR, as colors are stored
+        to_json(j["rgbTransform"], t.bgr);
+        return;
+    }
+
     // legacy: just 4x4 array representing HLS transform
     to_json(j, t.hls);
 
@@ -203,6 +358,7 @@ inline void from_json(json const& j, ColorTransform& t)
         // legacy: a 4x4 array representing the HLS transform
         // "color": [[ ... ]]
         from_json(j, t.hls);
+        t.classify();
     }
     else if (j.is_string())
     {
@@ -239,6 +395,21 @@ inline void from_json(json const& j, ColorTransform& t)
                 throw(std::exception("hlsTransform: unexpected parameters"));
             }
         }
+        else if (j.contains("rgbSink"))
+        {
+            // "color": { rgbSink: [r,g,b,a] }
+            float r = j["rgbSink"][0];
+            float g = j["rgbSink"][1];
+            float b = j["rgbSink"][2];
+            float a = j["rgbSink"][3];
+            t = ColorTransform::rgbSink(cv::Scalar_<float>(b, g, r, 1.0f), a);
+        }
+        else if (j.contains("rgbTransform"))
+        {
+            cv::Matx<float, 4, 4> m;
+            from_json(j["rgbTransform"], m);
+            t = ColorTransform::rgbTransform(m);
+        }
         else
         {
             throw(std::exception("Unknown ColorTransform"));
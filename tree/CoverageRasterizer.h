@@ -0,0 +1,448 @@
+#pragma once
+
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+
+
+//  Signed-area coverage accumulator for one polygon (or a set of same-winding polygons).
+//  Each edge deposits, into the cells of each scanline it crosses, the exact area it sweeps
+//  within that pixel; a running sum along the row then gives each pixel's coverage.
+//  Only rows and column ranges that edges actually touch are visited.
+//  All geometry is in full-image pixel coordinates: {rect} only selects which cells are kept,
+//  so a polygon rasterized into a tile gives the same pixels as in the full image, to within
+//  float rounding where edges are split at the rect's sides.
+class CoverageAccumulator
+{
+    cv::Rect rect;
+    int stride = 0;
+    std::vector<float> cells;       // kept all-zero between polygons: resolveRow clears what it reads
+    std::vector<int> rowMin, rowMax;
+
+public:
+
+    void begin(cv::Rect const &r)
+    {
+        rect = r;
+        stride = r.width + 2;
+        if (cells.size() < (size_t)stride * r.height)
+            cells.resize((size_t)stride * r.height, 0.0f);
+        rowMin.assign(r.height, INT_MAX);
+        rowMax.assign(r.height, -1);
+    }
+
+    void addPolygon(cv::Point2f const *pts, int n)
+    {
+        for (int i = 0; i < n; ++i)
+            addLine(pts[i], pts[(i + 1) % n]);
+    }
+
+    void addLine(cv::Point2f p0, cv::Point2f p1)
+    {
+        // split where the edge crosses the left or right side of the rect.
+        // parts outside are folded onto that side, where they carry the same winding into the row
+        float const xl = (float)rect.x, xr = (float)rect.br().x;
+        for (float xe : { xl, xr })
+        {
+            if ((p0.x < xe && p1.x > xe) || (p0.x > xe && p1.x < xe))
+            {
+                cv::Point2f pm(xe, p0.y + (xe - p0.x) / (p1.x - p0.x) * (p1.y - p0.y));
+                addLine(p0, pm);
+                addLine(pm, p1);
+                return;
+            }
+        }
+
+        p0.x = std::min(std::max(p0.x, xl), xr);
+        p1.x = std::min(std::max(p1.x, xl), xr);
+        addClippedLine(p0, p1);
+    }
+
+    //  Writes coverage [0..1] for the touched columns of {row} into cov[lo..hi), and clears them.
+    //  Columns outside [lo, hi) have no coverage. Returns false if the row is untouched.
+    bool resolveRow(int row, float *cov, int &lo, int &hi)
+    {
+        lo = rowMin[row];
+        int last = rowMax[row];
+        if (last < lo)
+            return false;
+
+        float *a = cells.data() + (size_t)row * stride;
+        hi = std::min(last + 1, rect.width);
+
+        float acc = 0.0f;
+        for (int x = lo; x < hi; ++x)
+        {
+            acc += a[x];
+            cov[x] = std::min(1.0f, std::abs(acc));
+        }
+        std::fill(a + lo, a + last + 1, 0.0f);
+        return (lo < hi);
+    }
+
+private:
+
+    void touch(int row, int x0, int x1)
+    {
+        if (x0 < rowMin[row]) rowMin[row] = x0;
+        if (x1 > rowMax[row]) rowMax[row] = x1;
+    }
+
+    void addClippedLine(cv::Point2f p0, cv::Point2f p1)
+    {
+        if (p0.y == p1.y)
+            return;
+
+        float dir = 1.0f;
+        if (p0.y > p1.y)
+        {
+            std::swap(p0, p1);
+            dir = -1.0f;
+        }
+
+        float const xl = (float)rect.x, xr = (float)rect.br().x;
+        float const dxdy = (p1.x - p0.x) / (p1.y - p0.y);
+
+        int y0 = std::max((int)std::floor(p0.y), rect.y);
+        int y1 = std::min((int)std::ceil(p1.y), rect.br().y);
+
+        for (int y = y0; y < y1; ++y)
+        {
+            // x at the top and bottom of this row's part of the edge, computed directly from the
+            // endpoints so the result doesn't depend on which row the rect starts at
+            float ya = std::max((float)y, p0.y);
+            float yb = std::min((float)(y + 1), p1.y);
+            float xa = std::min(std::max(p0.x + dxdy * (ya - p0.y), xl), xr);
+            float xb = std::min(std::max(p0.x + dxdy * (yb - p0.y), xl), xr);
+            float d = (yb - ya) * dir;
+
+            float x0 = std::min(xa, xb), x1 = std::max(xa, xb);
+            float x0floor = std::floor(x0);
+            int x0i = (int)x0floor;
+            float x1ceil = std::ceil(x1);
+            int x1i = (int)x1ceil;
+
+            int row = y - rect.y;
+            float *a = cells.data() + (size_t)row * stride - rect.x;
+
+            if (x1i <= x0i + 1)
+            {
+                // within one pixel: split the area at the edge's mean x
+                float xmf = 0.5f * (xa + xb) - x0floor;
+                a[x0i] += d - d * xmf;
+                a[x0i + 1] += d * xmf;
+                touch(row, x0i - rect.x, x0i + 1 - rect.x);
+            }
+            else
+            {
+                // across several pixels: a triangle in the first and last, linear ramp between
+                float s = 1.0f / (x1 - x0);
+                float x0f = x0 - x0floor;
+                float a0 = 0.5f * s * (1.0f - x0f) * (1.0f - x0f);
+                float x1f = x1 - x1ceil + 1.0f;
+                float am = 0.5f * s * x1f * x1f;
+
+                a[x0i] += d * a0;
+                if (x1i == x0i + 2)
+                {
+                    a[x0i + 1] += d * (1.0f - a0 - am);
+                }
+                else
+                {
+                    float a1 = s * (1.5f - x0f);
+                    a[x0i + 1] += d * (a1 - a0);
+                    for (int xi = x0i + 2; xi < x1i - 1; ++xi)
+                        a[xi] += d * s;
+                    float a2 = a1 + (float)(x1i - x0i - 3) * s;
+                    a[x1i - 1] += d * (1.0f - a2 - am);
+                }
+                a[x1i] += d * am;
+                touch(row, x0i - rect.x, x1i - rect.x);
+            }
+        }
+    }
+};
+
+
+//  Anti-aliased polygon fill with optional outline, in a single pass over the polygon's bounds.
+//  Fill and outline coverage are accumulated separately, then composited per pixel:
+//  fill over the destination, outline over that.
+//  The outline is one quad per edge and one octagon per vertex (round-ish joins). Each piece is
+//  rasterized on its own and merged with max, so pieces overlapping at the joins don't add up
+//  their anti-aliased edges.
+class CoverageRasterizer
+{
+    CoverageAccumulator fillCoverage;
+    CoverageAccumulator lineCoverage;       // one outline piece at a time
+    std::vector<float> fillRow, pieceRow;
+    std::vector<float> zeroRow;             // line coverage when there's no outline; never written
+    std::vector<cv::Point2f> shape;
+
+    cv::Rect lineRect;                      // outline coverage of the polygon's bounds
+    std::vector<float> lineCells;           // kept all-zero between polygons: draw clears what it reads
+    std::vector<int> lineMin, lineMax;
+
+public:
+
+    //  {pts} and {origin} are in full-image coordinates; {image} covers the full image from {origin}.
+    //  Colors are 0-255 BGR. Returns the region of {image} that may have changed.
+    cv::Rect draw(cv::Mat3b &image, cv::Point origin, std::vector<cv::Point2f> const &pts, cv::Scalar color, int lineThickness, cv::Scalar lineColor)
+    {
+        float const fill[3] = { clamp255(color(0)), clamp255(color(1)), clamp255(color(2)) };
+        float const line[3] = { clamp255(lineColor(0)), clamp255(lineColor(1)), clamp255(lineColor(2)) };
+        return draw(image, origin, pts, fill, lineThickness, line);
+    }
+
+    //  As above for float images. Colors are in the image's own units (e.g. linear light, 0..1)
+    //  and are blended as-is, without rounding.
+    cv::Rect draw(cv::Mat3f &image, cv::Point origin, std::vector<cv::Point2f> const &pts, cv::Vec3f color, int lineThickness, cv::Vec3f lineColor)
+    {
+        float const fill[3] = { color[0], color[1], color[2] };
+        float const line[3] = { lineColor[0], lineColor[1], lineColor[2] };
+        return draw(image, origin, pts, fill, lineThickness, line);
+    }
+
+private:
+
+    template<typename _Tp>
+    cv::Rect draw(cv::Mat_<cv::Vec<_Tp, 3> > &image, cv::Point origin, std::vector<cv::Point2f> const &pts, float const fill[3], int lineThickness, float const line[3])
+    {
+        int n = (int)pts.size();
+        if (n < 3 || image.empty())
+            return cv::Rect();
+
+        float const r = 0.5f * (float)lineThickness;
+        bool const outline = (lineThickness > 0);
+
+        // pixel bounds, including the outline, clipped to the image
+        float l = pts[0].x, t = pts[0].y, rt = pts[0].x, b = pts[0].y;
+        for (auto const &pt : pts)
+        {
+            l = std::min(l, pt.x); rt = std::max(rt, pt.x);
+            t = std::min(t, pt.y); b = std::max(b, pt.y);
+        }
+        float pad = outline ? r + 1.0f : 0.0f;
+        cv::Rect imageRect(origin, image.size());
+        int x0 = (int)std::floor(l - pad), y0 = (int)std::floor(t - pad);
+        cv::Rect bounds = cv::Rect(x0, y0, (int)std::ceil(rt + pad) + 1 - x0, (int)std::ceil(b + pad) + 1 - y0) & imageRect;
+        if (bounds.empty())
+            return cv::Rect();
+
+        fillCoverage.begin(bounds);
+        fillCoverage.addPolygon(pts.data(), n);
+
+        fillRow.resize(bounds.width);
+        if (zeroRow.size() < (size_t)bounds.width)
+            zeroRow.resize(bounds.width, 0.0f);
+
+        if (outline)
+        {
+            lineRect = bounds;
+            if (lineCells.size() < (size_t)bounds.area())
+                lineCells.resize((size_t)bounds.area(), 0.0f);
+            lineMin.assign(bounds.height, INT_MAX);
+            lineMax.assign(bounds.height, -1);
+            pieceRow.resize(bounds.width);
+            addOutline(pts, r);
+        }
+
+        for (int row = 0; row < bounds.height; ++row)
+        {
+            int flo = 0, fhi = 0, llo = 0, lhi = 0;
+            bool hasFill = fillCoverage.resolveRow(row, fillRow.data(), flo, fhi);
+            if (outline)
+            {
+                llo = lineMin[row];
+                lhi = lineMax[row];
+            }
+            bool hasLine = (llo < lhi);
+            if (!hasFill && !hasLine)
+                continue;
+
+            // composite over the union of both rows' touched spans. The line row is zero outside its span
+            if (!hasFill) { flo = llo; fhi = llo; }
+            if (!hasLine) { llo = flo; lhi = flo; }
+            int lo = std::min(flo, llo), hi = std::max(fhi, lhi);
+            std::fill(fillRow.begin() + lo, fillRow.begin() + flo, 0.0f);
+            std::fill(fillRow.begin() + fhi, fillRow.begin() + hi, 0.0f);
+
+            _Tp *dst = image.template ptr<_Tp>(bounds.y - origin.y + row) + 3 * (bounds.x - origin.x);
+            float *cl = outline ? lineCells.data() + (size_t)row * bounds.width : zeroRow.data();
+            blendRow(dst, fillRow.data(), cl, lo, hi, fill, line);
+
+            if (outline)
+                std::fill(cl + llo, cl + lhi, 0.0f);
+        }
+
+        return bounds - origin;
+    }
+
+    //  Blends fill, then line, over dst[lo..hi) by their coverage. Branch-free: pixels with no
+    //  coverage are written back unchanged. Four pixels (12 channels) at a time in SSE2, giving
+    //  the same results as the scalar tail
+    template<typename _Tp>
+    static void blendRow(_Tp *dst, float const *cf, float const *cl, int lo, int hi, float const fill[3], float const line[3])
+    {
+        // channel colors for pixels 0..3, as three vectors of 4 interleaved channels
+        __m128 const f0 = _mm_setr_ps(fill[0], fill[1], fill[2], fill[0]);
+        __m128 const f1 = _mm_setr_ps(fill[1], fill[2], fill[0], fill[1]);
+        __m128 const f2 = _mm_setr_ps(fill[2], fill[0], fill[1], fill[2]);
+        __m128 const l0 = _mm_setr_ps(line[0], line[1], line[2], line[0]);
+        __m128 const l1 = _mm_setr_ps(line[1], line[2], line[0], line[1]);
+        __m128 const l2 = _mm_setr_ps(line[2], line[0], line[1], line[2]);
+
+        int x = lo;
+        for (; x + 4 <= hi; x += 4)
+        {
+            __m128 p0, p1, p2;
+            load12(dst + 3 * x, p0, p1, p2);
+
+            // per-pixel coverage spread over its 3 channels
+            __m128 c = _mm_loadu_ps(cf + x);
+            p0 = blend(p0, f0, _mm_shuffle_ps(c, c, _MM_SHUFFLE(1, 0, 0, 0)));
+            p1 = blend(p1, f1, _mm_shuffle_ps(c, c, _MM_SHUFFLE(2, 2, 1, 1)));
+            p2 = blend(p2, f2, _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 3, 2)));
+            c = _mm_loadu_ps(cl + x);
+            p0 = blend(p0, l0, _mm_shuffle_ps(c, c, _MM_SHUFFLE(1, 0, 0, 0)));
+            p1 = blend(p1, l1, _mm_shuffle_ps(c, c, _MM_SHUFFLE(2, 2, 1, 1)));
+            p2 = blend(p2, l2, _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 3, 2)));
+
+            store12(dst + 3 * x, p0, p1, p2);
+        }
+
+        for (; x < hi; ++x)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                float p = dst[3 * x + c];
+                p += (fill[c] - p) * cf[x];
+                p += (line[c] - p) * cl[x];
+                store(dst[3 * x + c], p);
+            }
+        }
+    }
+
+    static __m128 blend(__m128 p, __m128 color, __m128 coverage)
+    {
+        return _mm_add_ps(p, _mm_mul_ps(_mm_sub_ps(color, p), coverage));
+    }
+
+    static void load12(float const *src, __m128 &p0, __m128 &p1, __m128 &p2)
+    {
+        p0 = _mm_loadu_ps(src);
+        p1 = _mm_loadu_ps(src + 4);
+        p2 = _mm_loadu_ps(src + 8);
+    }
+
+    static void store12(float *dst, __m128 p0, __m128 p1, __m128 p2)
+    {
+        _mm_storeu_ps(dst, p0);
+        _mm_storeu_ps(dst + 4, p1);
+        _mm_storeu_ps(dst + 8, p2);
+    }
+
+    //  12 bytes exactly: the pixels past the row's end may be another thread's tile
+    static void load12(uchar const *src, __m128 &p0, __m128 &p1, __m128 &p2)
+    {
+        int tail;
+        memcpy(&tail, src + 8, 4);
+        __m128i zero = _mm_setzero_si128();
+        __m128i v = _mm_unpacklo_epi64(_mm_loadl_epi64((__m128i const *)src), _mm_cvtsi32_si128(tail));
+        __m128i w0 = _mm_unpacklo_epi8(v, zero);
+        __m128i w1 = _mm_unpackhi_epi8(v, zero);
+        p0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(w0, zero));
+        p1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(w0, zero));
+        p2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(w1, zero));
+    }
+
+    //  rounds as store() does; values are within 0..255, so the saturating packs don't clip
+    static void store12(uchar *dst, __m128 p0, __m128 p1, __m128 p2)
+    {
+        __m128 const half = _mm_set1_ps(0.5f);
+        __m128i i0 = _mm_cvttps_epi32(_mm_add_ps(p0, half));
+        __m128i i1 = _mm_cvttps_epi32(_mm_add_ps(p1, half));
+        __m128i i2 = _mm_cvttps_epi32(_mm_add_ps(p2, half));
+        __m128i v = _mm_packus_epi16(_mm_packs_epi32(i0, i1), _mm_packs_epi32(i2, i2));
+        _mm_storel_epi64((__m128i *)dst, v);
+        int tail = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+        memcpy(dst + 8, &tail, 4);
+    }
+
+    static void store(uchar &dst, float p) { dst = (uchar)(p + 0.5f); }
+    static void store(float &dst, float p) { dst = p; }
+
+    static float clamp255(double v)
+    {
+        return (float)std::min(255.0, std::max(0.0, v));
+    }
+
+    void addOutline(std::vector<cv::Point2f> const &pts, float r)
+    {
+        int n = (int)pts.size();
+        shape.resize(8);
+
+        for (int i = 0; i < n; ++i)
+        {
+            cv::Point2f a = pts[i];
+            cv::Point2f b = pts[(i + 1) % n];
+            cv::Point2f e = b - a;
+            float len = std::sqrt(e.dot(e));
+            if (len > 0.0f)
+            {
+                cv::Point2f nrm(-e.y * r / len, e.x * r / len);
+                shape[0] = a + nrm;
+                shape[1] = b + nrm;
+                shape[2] = b - nrm;
+                shape[3] = a - nrm;
+                addOutlinePiece(shape.data(), 4);
+            }
+
+            // join: octagon around the vertex, wound the same way as the edge quads
+            static float const k = 0.70710678f;
+            static cv::Point2f const octagon[8] = {
+                { 1.0f, 0.0f }, { k, -k }, { 0.0f, -1.0f }, { -k, -k },
+                { -1.0f, 0.0f }, { -k, k }, { 0.0f, 1.0f }, { k, k } };
+            for (int j = 0; j < 8; ++j)
+                shape[j] = a + r * octagon[j];
+            addOutlinePiece(shape.data(), 8);
+        }
+    }
+
+    //  Rasterizes one outline piece on its own and merges its coverage into lineCells with max
+    void addOutlinePiece(cv::Point2f const *pts, int n)
+    {
+        float l = pts[0].x, t = pts[0].y, rt = pts[0].x, b = pts[0].y;
+        for (int i = 1; i < n; ++i)
+        {
+            l = std::min(l, pts[i].x); rt = std::max(rt, pts[i].x);
+            t = std::min(t, pts[i].y); b = std::max(b, pts[i].y);
+        }
+        int x0 = (int)std::floor(l), y0 = (int)std::floor(t);
+        cv::Rect rc = cv::Rect(x0, y0, (int)std::ceil(rt) + 1 - x0, (int)std::ceil(b) + 1 - y0) & lineRect;
+        if (rc.empty())
+            return;
+
+        lineCoverage.begin(rc);
+        lineCoverage.addPolygon(pts, n);
+
+        int dx = rc.x - lineRect.x;
+        for (int row = 0; row < rc.height; ++row)
+        {
+            int lo = 0, hi = 0;
+            if (!lineCoverage.resolveRow(row, pieceRow.data(), lo, hi))
+                continue;
+
+            int y = rc.y - lineRect.y + row;
+            float *cov = lineCells.data() + (size_t)y * lineRect.width + dx;
+            for (int x = lo; x < hi; ++x)
+                cov[x] = std::max(cov[x], pieceRow[x]);
+            lineMin[y] = std::min(lineMin[y], dx + lo);
+            lineMax[y] = std::max(lineMax[y], dx + hi);
+        }
+    }
+};
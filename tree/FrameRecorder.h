@@ -0,0 +1,241 @@
+#pragma once
+
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+#include <filesystem>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace fs = std::filesystem;
+
+
+//  Time-lapse recorder: captures a frame every so many nodes or so much model time,
+//  and encodes on background threads so growth isn't held up by the encoder.
+//  Captured frames wait in a bounded queue; when it's full, new frames are dropped
+//  (and counted) rather than stalling the caller.
+class FrameRecorder
+{
+public:
+    enum class Format { PNG_SEQUENCE, VIDEO };
+
+    int nodesPerFrame = 0;              // capture after this many nodes; 0 to not capture by node count
+    double modelTimePerFrame = 1.0;     // capture after this much model time; 0 to not capture by time
+    size_t maxQueuedFrames = 32;
+    double videoFps = 30.0;
+
+private:
+    struct Frame
+    {
+        cv::Mat image;
+        int index;
+    };
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<Frame> m_queue;
+    std::vector<cv::Mat> m_pool;        // encoded frames' buffers, for reuse
+    std::vector<std::thread> m_encoders;
+    bool m_stopping = false;
+
+    std::atomic<bool> m_recording = false;
+    std::mutex m_captureMutex;          // serializes capture() with start() and stop()
+    Format m_format = Format::PNG_SEQUENCE;
+    fs::path m_path;
+    cv::VideoWriter m_video;
+    cv::Size m_videoSize;
+
+    // capture state; under m_captureMutex
+    int m_frameIndex = 0;
+    int m_lastNodeCount = 0;
+    double m_lastModelTime = 0.0;
+
+    std::atomic<int> m_framesWritten = 0;
+    std::atomic<int> m_framesDropped = 0;
+
+public:
+    ~FrameRecorder()
+    {
+        stop();
+    }
+
+    bool isRecording() const { return m_recording; }
+    int framesWritten() const { return m_framesWritten; }
+    int framesDropped() const { return m_framesDropped; }
+
+    //  Starts recording to {path}: a directory of numbered PNGs, or a video file
+    void start(fs::path const &path, Format format)
+    {
+        stop();
+
+        std::unique_lock<std::mutex> capturing(m_captureMutex);
+        m_path = path;
+        m_format = format;
+        m_frameIndex = 0;
+        m_lastNodeCount = 0;
+        m_lastModelTime = 0.0;
+        m_framesWritten = 0;
+        m_framesDropped = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_stopping = false;
+            m_queue.clear();
+            m_pool.clear();
+        }
+
+        if (format == Format::PNG_SEQUENCE)
+            fs::create_directories(path);
+
+        // video frames must be written in order, so only PNGs get more than one encoder
+        int threads = (format == Format::VIDEO) ? 1 : (int)std::max(1u, std::min(4u, std::thread::hardware_concurrency() / 2));
+        for (int i = 0; i < threads; ++i)
+            m_encoders.emplace_back(&FrameRecorder::encode, this);
+
+        m_recording = true;
+        std::cout << "Recording to " << path << std::endl;
+    }
+
+    //  Stops capturing, and waits for queued frames to be encoded
+    void stop()
+    {
+        {
+            // once this is released, no capture is in flight and none will queue a frame
+            std::unique_lock<std::mutex> capturing(m_captureMutex);
+            if (!m_recording)
+                return;
+            m_recording = false;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+
+        for (auto &t : m_encoders)
+            t.join();
+        m_encoders.clear();
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_queue.clear();
+            m_pool.clear();
+        }
+        m_video.release();
+
+        std::cout << "Recording stopped: " << m_framesWritten << " frames written, " << m_framesDropped << " dropped" << std::endl;
+    }
+
+    //  Called at batch boundaries with the running node count and model time.
+    //  Queues a copy of {image} if a frame is due; never waits on the encoders.
+    //  May be called from another thread than start() and stop().
+    void capture(cv::Mat const &image, int nodeCount, double modelTime)
+    {
+        if (!m_recording || image.empty())
+            return;
+
+        std::unique_lock<std::mutex> capturing(m_captureMutex);
+        if (!m_recording)
+            return;
+
+        // restarted: count from the new run's start
+        if (nodeCount < m_lastNodeCount || modelTime < m_lastModelTime)
+        {
+            m_lastNodeCount = nodeCount;
+            m_lastModelTime = modelTime;
+        }
+
+        bool due = (m_frameIndex == 0)
+            || (nodesPerFrame > 0 && nodeCount - m_lastNodeCount >= nodesPerFrame)
+            || (modelTimePerFrame > 0.0 && modelTime - m_lastModelTime >= modelTimePerFrame);
+        if (!due)
+            return;
+
+        m_lastNodeCount = nodeCount;
+        m_lastModelTime = modelTime;
+
+        cv::Mat buffer;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_queue.size() >= maxQueuedFrames)
+            {
+                ++m_framesDropped;
+                return;
+            }
+            if (!m_pool.empty())
+            {
+                buffer = m_pool.back();
+                m_pool.pop_back();
+            }
+        }
+
+        image.copyTo(buffer);
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_queue.push_back(Frame{ buffer, m_frameIndex++ });
+        }
+        m_cv.notify_one();
+    }
+
+private:
+
+    void encode()
+    {
+        for (;;)
+        {
+            Frame frame;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait(lock, [&] { return m_stopping || !m_queue.empty(); });
+                if (m_queue.empty())
+                    return;
+                frame = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+
+            write(frame);
+            ++m_framesWritten;
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_pool.push_back(frame.image);
+        }
+    }
+
+    void write(Frame const &frame)
+    {
+        if (m_format == Format::PNG_SEQUENCE)
+        {
+            char filename[24];
+            sprintf_s(filename, "frame%05d.png", frame.index);
+            cv::imwrite((m_path / filename).string(), frame.image);
+            return;
+        }
+
+        // the video's size is set by its first frame; later frames of another size (after a restart) are scaled to it
+        if (!m_video.isOpened())
+        {
+            m_videoSize = frame.image.size();
+            m_video.open(m_path.string(), cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), videoFps, m_videoSize);
+        }
+
+        if (frame.image.size() == m_videoSize)
+        {
+            m_video.write(frame.image);
+        }
+        else
+        {
+            thread_local cv::Mat scaled;
+            cv::resize(frame.image, scaled, m_videoSize, 0, 0, cv::INTER_AREA);
+            m_video.write(scaled);
+        }
+    }
+};
@@ -109,7 +109,7 @@ private:
     // get integer grid point nearest node centroid
     cv::Point getNodeKey(qnode const &node) const
     {
-        vector<cv::Point2f> pts;
+        thread_local vector<cv::Point2f> pts;
         getPolyPoints(node, pts);
         cv::Point center = ((pts[0] + pts[2]) / 2.0f );
         return center;
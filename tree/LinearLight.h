@@ -0,0 +1,86 @@
+#pragma once
+
+
+#include "util.h"
+#include <opencv2/core/core.hpp>
+#include <algorithm>
+#include <cmath>
+
+
+//  Linear-light rendering: colors are blended as light intensities, in float, and only converted
+//  to 8-bit sRGB once, when a supersampled image is resolved to its output size.
+//  Antialiased edges and downsampling then keep their brightness instead of darkening as
+//  gamma-space blending does.
+class LinearLight
+{
+public:
+    //  sRGB component, 0-255, to linear 0..1
+    static float toLinear(double v)
+    {
+        double c = std::min(1.0, std::max(0.0, v / 255.0));
+        return (float)(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+    }
+
+    //  0-255 BGR to linear BGR
+    static cv::Vec3f toLinear(cv::Scalar const &bgr)
+    {
+        return cv::Vec3f(toLinear(bgr(0)), toLinear(bgr(1)), toLinear(bgr(2)));
+    }
+
+    //  Averages each {supersampling} x {supersampling} block of linear {src} and converts to 8-bit sRGB,
+    //  in one pass over {src}. {dst} is sized to src / supersampling.
+    static void resolve(cv::Mat3f const &src, int supersampling, cv::Mat3b &dst)
+    {
+        int const ss = std::max(1, supersampling);
+        dst.create(src.rows / ss, src.cols / ss);
+
+        uchar const *lut = getSrgbLut();
+        float const lutScale = (float)(LUT_SIZE - 1) / (float)(ss * ss);
+
+        util::parallelFor(dst.rows, [&](int y)
+        {
+            // sum the block's rows, then its columns
+            thread_local std::vector<float> sum;
+            sum.assign((size_t)src.cols * 3, 0.0f);
+            for (int j = 0; j < ss; ++j)
+            {
+                float const *s = (float const *)src.ptr(y * ss + j);
+                for (int i = 0; i < src.cols * 3; ++i)
+                    sum[i] += s[i];
+            }
+
+            uchar *d = dst.ptr<uchar>(y);
+            for (int x = 0; x < dst.cols; ++x)
+            {
+                float const *block = sum.data() + 3 * x * ss;
+                for (int c = 0; c < 3; ++c)
+                {
+                    float v = 0.0f;
+                    for (int k = 0; k < ss; ++k)
+                        v += block[3 * k + c];
+                    int idx = (int)(v * lutScale + 0.5f);
+                    d[3 * x + c] = lut[std::min(std::max(idx, 0), LUT_SIZE - 1)];
+                }
+            }
+        });
+    }
+
+private:
+    static constexpr int LUT_SIZE = 4096;
+
+    //  linear 0..1, in LUT_SIZE steps, to 8-bit sRGB
+    static uchar const *getSrgbLut()
+    {
+        static uchar const *lut = [] {
+            static uchar table[LUT_SIZE];
+            for (int i = 0; i < LUT_SIZE; ++i)
+            {
+                double c = (double)i / (LUT_SIZE - 1);
+                double v = (c <= 0.0031308 ? 12.92 * c : 1.055 * std::pow(c, 1.0 / 2.4) - 0.055);
+                table[i] = cv::saturate_cast<uchar>(255.0 * v);
+            }
+            return table;
+        }();
+        return lut;
+    }
+};
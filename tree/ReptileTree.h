@@ -86,7 +86,7 @@ public:
                     qtransform(90, 0.5, cv::Point2f(0, 2))
                 } };
 
-            m_rootNode.globalTransform = util::transform3x3::getTranslate(-1, -1);
+            m_rootNode.globalTransform = util::transform3x3::getTranslate(-1.0f, -1.0f);
             break;
 
         case 3: // 1:r3:2 right triangle reptile
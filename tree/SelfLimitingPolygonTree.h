@@ -3,10 +3,12 @@
 
 #include "tree.h"
 #include "util.h"
+#include "TiledRenderer.h"
 #include <vector>
 #include <iostream>
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc.hpp>
+#include <algorithm>
 #include <array>
 #include <list>
 #include <unordered_set>
@@ -55,6 +57,23 @@ protected:
     // temp drawing layer, same size as field, for drawing individual nodes and checking for intersection
     mutable cv::Mat1b m_fieldLayer;
     mutable cv::Rect m_fieldLayerBoundingRect;
+    mutable int m_fieldLayerNodeId = -1;    // node last drawn on the layer
+
+    // negative viability cache: unless something is removed, the field only gains pixels,
+    // so a pose that collided once keeps colliding. Rejected pose hashes are kept in a fixed-size
+    // 4-way set-associative table, with the field cell of each pose's origin, so that freeing space
+    // can drop just the nearby poses. A full set evicts one of its entries, so memory is capped.
+    static const int POSE_CELL_SHIFT = 5;           // 32x32-pixel cells
+    static const int REJECTED_POSE_WAYS = 4;
+    static const int REJECTED_POSE_SETS = 1 << 14;  // x4 ways x16 bytes: 1MB
+    struct RejectedPose
+    {
+        uint64_t pose = 0;      // 0: empty
+        uint64_t cell = 0;
+    };
+    std::vector<RejectedPose> m_rejectedPoses;
+    // farthest any cached pose's footprint reaches from its origin, in field pixels
+    int m_rejectedPoseReach = 0;
 
 public:
 
@@ -231,6 +250,11 @@ public:
         nodeQueue.push(rootNode);
 
         m_nodeList.clear();
+        m_nodeIndex.clear();
+        m_frontier.clear();
+
+        m_rejectedPoses.assign(REJECTED_POSE_SETS * REJECTED_POSE_WAYS, RejectedPose());
+        m_rejectedPoseReach = 0;
     }
 
     virtual void createRootNode(qnode & rootNode)
@@ -245,15 +269,6 @@ public:
         rootNode.globalTransform = util::transform3x3::getScaleTranslate(1.0f, -centroid.x, -centroid.y);
     }
 
-    virtual void beget(qnode const & parent, qtransform const & t, qnode & child) override
-    {
-        qtree::beget(parent, t, child);
-
-        // apply affine transform in HLS space
-        child.color = t.colorTransform.apply(parent.color);
-    }
-
-
     virtual bool isViable(qnode const &node) const override
     {
         if (!node) 
@@ -262,12 +277,102 @@ public:
         if (fabs(node.det()) < minimumScale*minimumScale)
             return false;
 
+        // already known to collide?
+        if (isRejectedPose(getPoseKey(node, getFieldOrigin(node))))
+            return false;
+
         if (!drawField(node))
             return false;   // out of image bounds
 
+        // collisions are cached by rejectNode
         thread_local cv::Mat andmat;
         cv::bitwise_and(m_field(m_fieldLayerBoundingRect), m_fieldLayer(m_fieldLayerBoundingRect), andmat);
-        return(!cv::countNonZero(andmat));
+        return !cv::countNonZero(andmat);
+    }
+
+    bool isRejectedPose(uint64_t pose) const
+    {
+        RejectedPose const *set = &m_rejectedPoses[(pose & (REJECTED_POSE_SETS - 1)) * REJECTED_POSE_WAYS];
+        for (int i = 0; i < REJECTED_POSE_WAYS; ++i)
+            if (set[i].pose == pose)
+                return true;
+        return false;
+    }
+
+    //  caches the pose of {node}, which collided when drawn on the field layer
+    void addRejectedPose(qnode const &node)
+    {
+        cv::Point2f origin = getFieldOrigin(node);
+        uint64_t pose = getPoseKey(node, origin);
+
+        RejectedPose *set = &m_rejectedPoses[(pose & (REJECTED_POSE_SETS - 1)) * REJECTED_POSE_WAYS];
+        RejectedPose *slot = &set[(pose >> 32) & (REJECTED_POSE_WAYS - 1)];     // evicted if the set is full
+        for (int i = 0; i < REJECTED_POSE_WAYS; ++i)
+        {
+            if (set[i].pose == 0 || set[i].pose == pose)
+            {
+                slot = &set[i];
+                break;
+            }
+        }
+        slot->pose = pose;
+        slot->cell = getPoseCell(origin);
+
+        // how far its footprint reaches from the cell
+        auto const &rc = m_fieldLayerBoundingRect;
+        float reach = std::max(
+            std::max(fabs(rc.x - origin.x), fabs(rc.br().x - origin.x)),
+            std::max(fabs(rc.y - origin.y), fabs(rc.br().y - origin.y)));
+        m_rejectedPoseReach = std::max(m_rejectedPoseReach, (int)ceil(reach));
+    }
+
+    //  node's polygon origin in field coords
+    cv::Point2f getFieldOrigin(qnode const &node) const
+    {
+        auto const &f = m_fieldTransform;
+        float x = (float)node.globalTransform(0, 2), y = (float)node.globalTransform(1, 2);
+        return cv::Point2f(f(0, 0)*x + f(0, 1)*y + f(0, 2), f(1, 0)*x + f(1, 1)*y + f(1, 2));
+    }
+
+    static uint64_t getCellKey(int cx, int cy)
+    {
+        return ((uint64_t)(uint32_t)cy << 32) | (uint32_t)cx;
+    }
+
+    static uint64_t getPoseCell(cv::Point2f const &origin)
+    {
+        return getCellKey((int)floor(origin.x) >> POSE_CELL_SHIFT, (int)floor(origin.y) >> POSE_CELL_SHIFT);
+    }
+
+    //  hash of the node's pose, quantized to 1/8 field pixel and 1/65536 in scale/rotation
+    uint64_t getPoseKey(qnode const &node, cv::Point2f const &origin) const
+    {
+        auto const &g = node.globalTransform;
+        uint64_t h = 0;
+        h = util::hashCombine(h, (uint64_t)llround(origin.x * 8.0f));
+        h = util::hashCombine(h, (uint64_t)llround(origin.y * 8.0f));
+        h = util::hashCombine(h, (uint64_t)llround(g(0, 0) * 65536.0f));
+        h = util::hashCombine(h, (uint64_t)llround(g(0, 1) * 65536.0f));
+        h = util::hashCombine(h, (uint64_t)llround(g(1, 0) * 65536.0f));
+        h = util::hashCombine(h, (uint64_t)llround(g(1, 1) * 65536.0f));
+        return h ? h : 1;       // 0 marks empty cache entries
+    }
+
+    //  drops cached rejections whose footprint could overlap {fieldRect}.
+    //  Scans the whole table, which is fine for removals, as they're rare
+    void invalidateRejectedPoses(cv::Rect const &fieldRect)
+    {
+        int r = m_rejectedPoseReach;
+        int x0 = (fieldRect.x - r) >> POSE_CELL_SHIFT;
+        int y0 = (fieldRect.y - r) >> POSE_CELL_SHIFT;
+        int x1 = (fieldRect.br().x + r) >> POSE_CELL_SHIFT;
+        int y1 = (fieldRect.br().y + r) >> POSE_CELL_SHIFT;
+        for (auto &e : m_rejectedPoses)
+        {
+            int cx = (int)(uint32_t)e.cell, cy = (int)(uint32_t)(e.cell >> 32);
+            if (e.pose != 0 && cx >= x0 && cx <= x1 && cy >= y0 && cy <= y1)
+                e = RejectedPose();
+        }
     }
 
     //  draw node on field stage layer to prepare for collision detection
@@ -275,10 +380,12 @@ public:
     //  quick detection means that this node is not viable.
     bool drawField(qnode const &node) const
     {
-        vector<cv::Point2f> v;
+        // per-thread scratch buffers, reused from node to node
+        thread_local vector<cv::Point2f> v;
+        thread_local vector<cv::Point> pts;
 
         // first, transform node polygon to model coordinates
-        cv::transform(polygon, v, node.globalTransform.get_minor<2, 3>(0, 0));
+        util::polygon::transform(polygon, v, node.globalTransform);
 
         // test each vertex against maxRadius
         for (auto const& p : v)
@@ -286,26 +393,30 @@ public:
                 return false;
 
         // transform model polygon to field coords
-        Matx33 m = m_fieldTransform * node.globalTransform;
-        cv::transform(polygon, v, m.get_minor<2, 3>(0, 0));
+        NodeTransform m = NodeTransform(m_fieldTransform) * node.globalTransform;
+        util::polygon::transform(polygon, v, m);
         // convert to int-coordinate struct for cv::polylines
-        vector<vector<cv::Point> > pts(1);
-        for (auto const& p : v)
-            pts[0].push_back(p);
+        pts.resize(v.size());
+        for (size_t i = 0; i < v.size(); ++i)
+            pts[i] = v[i];
 
         // (double) check that coords are within field
-        m_fieldLayerBoundingRect = cv::boundingRect(pts[0]);
+        m_fieldLayerBoundingRect = cv::boundingRect(pts);
         if ((cv::Rect(0, 0, m_field.cols, m_field.rows) & m_fieldLayerBoundingRect) != m_fieldLayerBoundingRect)
             return false;
 
+        cv::Point const *ppts = pts.data();
+        int npts = (int)pts.size();
+
         // clear a region of our scratch layer and draw node on it
         m_fieldLayer(m_fieldLayerBoundingRect) = 0;
-        cv::fillPoly(m_fieldLayer, pts, cv::Scalar(255), cv::LineTypes::LINE_8);
+        cv::fillPoly(m_fieldLayer, &ppts, &npts, 1, cv::Scalar(255), cv::LineTypes::LINE_8);
         // reduce by drawing outline in black:
         // this is a bit of a hack to get around the problem of OpenCV always drawing a pixel-wide boundary even when only a fill is specified
-        cv::polylines(m_fieldLayer, pts, true, cv::Scalar(0), 1, cv::LineTypes::LINE_8);
+        cv::polylines(m_fieldLayer, &ppts, &npts, 1, true, cv::Scalar(0), 1, cv::LineTypes::LINE_8);
         // double-draw and soften the line--purely for aesthetics, since the field layer is exported as well
-        cv::polylines(m_fieldLayer, pts, true, cv::Scalar(0), 1, cv::LineTypes::LINE_AA);
+        cv::polylines(m_fieldLayer, &ppts, &npts, 1, true, cv::Scalar(0), 1, cv::LineTypes::LINE_AA);
+        m_fieldLayerNodeId = node.id;
 
         return true;
     }
@@ -315,43 +426,69 @@ public:
         drawField(node);
         cv::bitwise_not(m_fieldLayer(m_fieldLayerBoundingRect), m_fieldLayer(m_fieldLayerBoundingRect));
         cv::bitwise_and(m_field(m_fieldLayerBoundingRect), m_fieldLayer(m_fieldLayerBoundingRect), m_field(m_fieldLayerBoundingRect));
+
+        // poses that collided with this node may be viable now
+        invalidateRejectedPoses(m_fieldLayerBoundingRect);
     }
 
     std::list<qnode> m_nodeList;
+    // by node id: the node's place in m_nodeList, or m_nodeList.end(). Ids are assigned in sequence,
+    // so this grows geometrically with the tree rather than allocating per node
+    std::vector<std::list<qnode>::iterator> m_nodeIndex;
     std::unordered_set<int> m_markedForDeletion;
 
+    // frontier, by node id: nodes with at least one rejected child that could become viable
+    // if space is freed or the domain changes. regrowAll re-seeds only these.
+    std::vector<uint8_t> m_frontier;
+
+    //  grows {v} to hold index {i}, doubling so growth is amortized
+    template<typename _Tp>
+    static void growToIndex(std::vector<_Tp> &v, int i, _Tp const &fill)
+    {
+        if (i >= (int)v.size())
+            v.resize(std::max((size_t)i + 1, 2 * v.size()), fill);
+    }
+
     virtual void addNode(qnode &currentNode) override
     {
         qtree::addNode(currentNode);
 
         m_nodeList.push_back(currentNode);
+        growToIndex(m_nodeIndex, currentNode.id, m_nodeList.end());
+        m_nodeIndex[currentNode.id] = std::prev(m_nodeList.end());
 
         // update field image: composite new node
         cv::bitwise_or(m_field(m_fieldLayerBoundingRect), m_fieldLayer(m_fieldLayerBoundingRect), m_field(m_fieldLayerBoundingRect));
     }
 
+    virtual void rejectNode(qnode const &node) override
+    {
+        // too small or degenerate: no removal will ever make this child viable
+        if (!node || fabs(node.det()) < minimumScale*minimumScale)
+            return;
+
+        // drawn on the field layer, yet rejected: it collided
+        if (m_fieldLayerNodeId == node.id)
+            addRejectedPose(node);
+
+        // out of bounds or colliding: parent stays on the frontier
+        addToFrontier(node.parentId);
+    }
+
+    void addToFrontier(int id)
+    {
+        growToIndex(m_frontier, id, (uint8_t)0);
+        m_frontier[id] = 1;
+    }
+
     std::list<qnode>::const_iterator findNode(int id) const
     {
-        for (auto it = m_nodeList.begin(); it!=m_nodeList.end(); ++it)
-        {
-            if (it->id == id)
-            {
-                return it;
-            }
-        }
-        return m_nodeList.end();
+        return (id >= 0 && id < (int)m_nodeIndex.size()) ? std::list<qnode>::const_iterator(m_nodeIndex[id]) : m_nodeList.end();
     }
 
     std::list<qnode>::iterator findNode(int id)
     {
-        for (auto it = m_nodeList.begin(); it != m_nodeList.end(); ++it)
-        {
-            if (it->id == id)
-            {
-                return it;
-            }
-        }
-        return m_nodeList.end();
+        return (id >= 0 && id < (int)m_nodeIndex.size()) ? m_nodeIndex[id] : m_nodeList.end();
     }
 
     void getLineage(qnode const & node, std::vector<string> & lineage) const override
@@ -374,9 +511,9 @@ public:
 
     virtual void getNodesIntersecting(cv::Rect2f const &rect, std::vector<qnode> &nodes) const override
     {
+        thread_local std::vector<cv::Point2f> pts;
         for (auto & node : m_nodeList)
         {
-            std::vector<cv::Point2f> pts;
             getPolyPoints(node, pts);
 
             if (cv::pointPolygonTest(pts, rect.tl(), false) >= 0.0)
@@ -411,6 +548,13 @@ public:
         }
         cout << " -- removing " << (it->id) << " from " << (it->parentId) << " remaining: " << m_nodeList.size() << endl;
         undrawNode(*it);
+
+        // let the parent re-bud into the freed space
+        addToFrontier(it->parentId);
+        if (it->id < (int)m_frontier.size())
+            m_frontier[it->id] = 0;
+
+        m_nodeIndex[it->id] = m_nodeList.end();
         it = m_nodeList.erase(it);
         return 1;
         /*
@@ -525,30 +669,85 @@ public:
     //    return false;
     //}
 
+    //  Re-seeds frontier nodes only: those with a rejected child that may be viable now that
+    //  the domain has changed or nodes have been removed.
     virtual void regrowAll() override
     {
-        for (auto & currentNode : m_nodeList)
+        for (auto const &currentNode : m_nodeList)
         {
-            // !TODO! this is duplicated code
+            if (currentNode.id >= (int)m_frontier.size() || !m_frontier[currentNode.id])
+                continue;
+
+            // if rejected again, children will put this node back on the frontier
+            m_frontier[currentNode.id] = 0;
+
             // create a child node for each available transform.
             // all child nodes are added to the queue, even if not viable.
-            for (auto const &t : transforms)
+            for (int i = 0; i < (int)transforms.size(); ++i)
             {
                 qnode child;
-                beget(currentNode, t, child);
+                beget(currentNode, transforms[i], child);
+                child.transformIndex = i;
                 nodeQueue.push(child);
             }
         }
     }
 
-    //  Node draw function for tree of nodes with all the same polygon
-    virtual void redrawAll(qcanvas &canvas) override
+    //  Re-derives colors of accepted nodes, and of children still waiting in the queue,
+    //  from the current color transforms. Nodes are stored in the order they were accepted,
+    //  so a parent is always recolored before its children.
+    virtual bool recolorAll() override
     {
-        canvas.image = 0;
         for (auto & node : m_nodeList)
+            recolorNode(node);
+
+        // queue order depends only on beginTime, so colors can be updated in place
+        for (auto & node : util::container(nodeQueue))
+            recolorNode(node);
+
+        return true;
+    }
+
+    void recolorNode(qnode &node) const
+    {
+        if (node.transformIndex < 0)
         {
-            drawNode(canvas, node);
+            if (node.id == 0)
+            {
+                node.color = rootNodeColor;
+                node.colorSpace = ColorSpace::BGR;
+            }
+            return;
         }
+
+        auto it = findNode(node.parentId);
+        if (it == m_nodeList.end() || node.transformIndex >= (int)transforms.size())
+            return;     // parent removed or transform dropped: keep the color it was grown with
+
+        node.colorSpace = it->colorSpace;
+        node.color = transforms[node.transformIndex].colorTransform.apply(it->color, node.colorSpace);
+    }
+
+    virtual bool forEachNode(std::function<void(qnode const &)> const &fn) const override
+    {
+        for (auto const & node : m_nodeList)
+            fn(node);
+        return true;
+    }
+
+    //  Node draw function for tree of nodes with all the same polygon
+    virtual bool redrawAll(qcanvas &canvas) override
+    {
+        canvas.image = 0;
+
+        std::vector<qnode const *> nodes;
+        nodes.reserve(m_nodeList.size());
+        for (auto const & node : m_nodeList)
+            nodes.push_back(&node);
+
+        TiledRenderer().render(*this, canvas, nodes);
+        canvas.invalidate();
+        return true;
     }
 
 };
@@ -725,17 +924,7 @@ public:
         rootNodeColor = cv::Scalar(1.0, 1.0, 0.0, 1);
 
         // override polygon with thorn/versatile polygon
-        polygon.clear();
-        cv::Point2f pt(0, 0);
-        polygon.push_back(pt);
-        polygon.push_back(pt += util::polygon::headingStep(  0.0f));
-        polygon.push_back(pt += util::polygon::headingStep(120.0f));
-        polygon.push_back(pt += util::polygon::headingStep(105.0f));
-        polygon.push_back(pt += util::polygon::headingStep( 90.0f));
-        polygon.push_back(pt += util::polygon::headingStep( 75.0f));
-        polygon.push_back(pt += util::polygon::headingStep(240.0f));
-        polygon.push_back(pt += util::polygon::headingStep(255.0f));
-        polygon.push_back(pt += util::polygon::headingStep(270.0f));
+        util::polygon::createHeadingPath(polygon, { 0.0, 120.0, 105.0, 90.0, 75.0, 240.0, 255.0, 270.0 });
 
         drawPolygon = polygon;
         // modify polygon that's drawn
@@ -792,14 +981,19 @@ public:
         cv::imwrite(imagePath.string(), m_field);
     }
 
+    virtual std::vector<cv::Point2f> const &getDrawPolygon() const override
+    {
+        return drawPolygon;
+    }
+
     void drawNode(qcanvas &canvas, qnode const &node) override
     {
         cv::Scalar color =
-            //(node.det() < 0) ? 255.0 * (cv::Scalar(1.0, 1.0, 1.0, 1.0) - node.color) : 
-            255.0 * node.color;
+            //(node.det() < 0) ? 255.0 * (cv::Scalar(1.0, 1.0, 1.0, 1.0) - node.bgr()) : 
+            255.0 * node.bgr();
 
         // todo
-        canvas.fillPoly(drawPolygon, node.globalTransform, 255.0 * node.color, lineThickness, lineColor);
+        canvas.fillPoly(drawPolygon, node.globalTransform, color, lineThickness, lineColor);
 
         // modify polygon that's drawn
         //pts[0].resize(4);
@@ -0,0 +1,85 @@
+#pragma once
+
+
+#include "util.h"
+#include <opencv2/core/core.hpp>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+
+//  Triple-buffered snapshots of a canvas image, for display on another thread.
+//  The drawing thread publishes whole frames at batch boundaries and the display thread picks up
+//  the latest published one; neither ever waits for the other, and a displayed frame is never
+//  drawn into. Each buffer is brought up to date by copying only the regions drawn since it
+//  was last published.
+//  One drawing thread and one display thread at a time.
+class SnapshotBuffer
+{
+public:
+    struct Frame
+    {
+        cv::Mat image;
+        uint64_t sequence = 0;                          // 1, 2, 3... per publish
+        std::chrono::steady_clock::time_point time;     // when published
+        std::vector<cv::Rect> dirtyRects;               // regions changed since sequence - 1
+    };
+
+private:
+    static int const FRESH = 4;     // flag on m_ready: published and not yet acquired
+
+    Frame m_frames[3];
+    std::vector<cv::Rect> m_missing[3];     // per buffer: regions drawn since it was last published. drawing thread only
+    int m_back = 0;                         // drawing thread's buffer
+    int m_front = 1;                        // display thread's buffer
+    std::atomic<int> m_ready = 2;           // latest published buffer, | FRESH
+    uint64_t m_sequence = 0;
+
+public:
+
+    //  Drawing thread: publishes {image}, given the regions drawn since the previous publish
+    void publish(cv::Mat const &image, std::vector<cv::Rect> const &dirtyRects)
+    {
+        cv::Rect imageRect(0, 0, image.cols, image.rows);
+        for (auto &missing : m_missing)
+            for (auto const &rc : dirtyRects)
+                util::addRegion(missing, rc & imageRect);
+
+        Frame &frame = m_frames[m_back];
+        if (frame.image.size() != image.size() || frame.image.type() != image.type())
+        {
+            image.copyTo(frame.image);
+        }
+        else
+        {
+            for (auto const &rc : m_missing[m_back])
+                image(rc).copyTo(frame.image(rc));
+        }
+        m_missing[m_back].clear();
+
+        frame.sequence = ++m_sequence;
+        frame.time = std::chrono::steady_clock::now();
+        frame.dirtyRects = dirtyRects;
+
+        m_back = m_ready.exchange(m_back | FRESH) & ~FRESH;
+    }
+
+    //  Display thread: returns the most recently published frame, which stays valid until the next call.
+    //  {isNew} is set false if it was already returned by the previous call.
+    Frame const &acquire(bool *isNew = nullptr)
+    {
+        bool fresh = (m_ready.load() & FRESH) != 0;
+        if (fresh)
+            m_front = m_ready.exchange(m_front) & ~FRESH;
+
+        if (isNew)
+            *isNew = fresh;
+        return m_frames[m_front];
+    }
+
+    //  Seconds since {frame} was published: how far the display lags the drawing
+    static double age(Frame const &frame)
+    {
+        return std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - frame.time).count();
+    }
+};
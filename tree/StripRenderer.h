@@ -0,0 +1,213 @@
+#pragma once
+
+
+#include "tree.h"
+#include "TiledRenderer.h"
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+
+namespace fs = std::filesystem;
+
+
+//  Streaming writer for uncompressed 8-bit RGB BigTIFF files, one strip at a time.
+//  Strips are written as they arrive; their offsets, and the directory (IFD) that points to them,
+//  go at the end of the file, so nothing but the strip table is kept in memory.
+//  BigTIFF's 64-bit offsets allow files past 4GB.
+class BigTiffWriter
+{
+    std::ofstream out;
+    cv::Size imageSize;
+    int rowsPerStrip = 0;
+    std::vector<uint64_t> stripOffsets;
+    std::vector<uint64_t> stripByteCounts;
+    cv::Mat rgb;
+
+    enum : uint16_t { SHORT = 3, LONG = 4, LONG8 = 16 };
+
+public:
+    bool open(fs::path const &path, cv::Size size, int rowsPerStrip_)
+    {
+        out.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+
+        imageSize = size;
+        rowsPerStrip = rowsPerStrip_;
+        stripOffsets.clear();
+        stripByteCounts.clear();
+
+        // header: little-endian, version 43 (BigTIFF), 8-byte offsets, first IFD offset (patched by close())
+        out.write("II", 2);
+        put<uint16_t>(43);
+        put<uint16_t>(8);
+        put<uint16_t>(0);
+        put<uint64_t>(0);
+        return true;
+    }
+
+    //  Appends the next strip: {rowsPerStrip} rows of BGR pixels (fewer for the last strip)
+    void writeStrip(cv::Mat3b const &strip)
+    {
+        cv::cvtColor(strip, rgb, cv::COLOR_BGR2RGB);
+
+        stripOffsets.push_back((uint64_t)out.tellp());
+        size_t rowBytes = (size_t)rgb.cols * 3;
+        for (int y = 0; y < rgb.rows; ++y)
+            out.write((char const *)rgb.ptr(y), rowBytes);
+        stripByteCounts.push_back((uint64_t)rowBytes * rgb.rows);
+    }
+
+    //  Writes the strip table and directory, and finishes the file. Returns false on any write error
+    bool close()
+    {
+        if (!out.is_open())
+            return false;
+
+        uint64_t offsetsAt = writeArray(stripOffsets);
+        uint64_t countsAt = writeArray(stripByteCounts);
+
+        uint64_t ifdAt = (uint64_t)out.tellp();
+        put<uint64_t>(10);      // entries, in ascending tag order
+        putEntry(256, LONG, 1, (uint64_t)imageSize.width);                      // ImageWidth
+        putEntry(257, LONG, 1, (uint64_t)imageSize.height);                     // ImageLength
+        putEntry(258, SHORT, 3, 8 | (8ull << 16) | (8ull << 32));               // BitsPerSample 8,8,8
+        putEntry(259, SHORT, 1, 1);                                             // Compression: none
+        putEntry(262, SHORT, 1, 2);                                             // PhotometricInterpretation: RGB
+        putEntry(273, LONG8, stripOffsets.size(), offsetsAt);                   // StripOffsets
+        putEntry(277, SHORT, 1, 3);                                             // SamplesPerPixel
+        putEntry(278, LONG, 1, (uint64_t)rowsPerStrip);                         // RowsPerStrip
+        putEntry(279, LONG8, stripByteCounts.size(), countsAt);                 // StripByteCounts
+        putEntry(284, SHORT, 1, 1);                                             // PlanarConfiguration: chunky
+        put<uint64_t>(0);       // no next IFD
+
+        out.seekp(8);
+        put<uint64_t>(ifdAt);
+
+        bool ok = !out.fail();
+        out.close();
+        return ok;
+    }
+
+private:
+    template<typename _Tp>
+    void put(_Tp v)
+    {
+        out.write((char const *)&v, sizeof(v));
+    }
+
+    //  Arrays that fit in 8 bytes are stored in the entry itself; returns what the entry should hold
+    uint64_t writeArray(std::vector<uint64_t> const &values)
+    {
+        if (values.size() == 1)
+            return values[0];
+
+        uint64_t at = (uint64_t)out.tellp();
+        out.write((char const *)values.data(), values.size() * sizeof(uint64_t));
+        return at;
+    }
+
+    void putEntry(uint16_t tag, uint16_t type, uint64_t count, uint64_t value)
+    {
+        put<uint16_t>(tag);
+        put<uint16_t>(type);
+        put<uint64_t>(count);
+        put<uint64_t>(value);
+    }
+};
+
+
+//  Renders images of any size, one horizontal strip at a time.
+//  Nodes are binned by the strips their bounds touch, then each strip is rendered (in parallel
+//  tiles) from its own bin and handed on, so pixel memory is one strip, whatever the image size.
+//  8-bit strips match the corresponding rows of a single full-size render.
+//  With {linearLight} or {supersampling} > 1, strips are drawn in linear-light float at
+//  {supersampling} times the resolution, and resolved to 8-bit sRGB as each strip completes.
+class StripRenderer
+{
+public:
+    int stripHeight = 256;
+    int supersampling = 1;
+    bool linearLight = false;
+
+public:
+    //  Renders {tree} framed as qcanvas::setScaleToFit({size}) would, and streams it to a BigTIFF file.
+    //  Returns false if the tree doesn't retain its nodes or the file can't be written.
+    bool render(qtree &tree, cv::Size size, float padding, fs::path const &path) const
+    {
+        BigTiffWriter writer;
+        if (!writer.open(path, size, stripHeight))
+            return false;
+
+        bool retained = render(tree, size, padding, [&](cv::Mat3b const &strip, int) { writer.writeStrip(strip); });
+        return writer.close() && retained;
+    }
+
+    //  As above, passing each strip, top to bottom, to {sink} with the image row it starts at
+    bool render(qtree &tree, cv::Size size, float padding, std::function<void(cv::Mat3b const &, int)> const &sink) const
+    {
+        qcanvas canvas;
+        canvas.setScaleToFit(tree.getBoundingRect(), padding, size);
+
+        // bin nodes by strip, in drawing order
+        int strips = (size.height + stripHeight - 1) / stripHeight;
+        std::vector<std::vector<qnode const *> > bins(strips);
+        cv::Rect imageRect(0, 0, size.width, size.height);
+
+        bool retained = tree.forEachNode([&](qnode const &node)
+        {
+            cv::Rect bounds = TiledRenderer::getNodeBounds(tree, canvas, node) & imageRect;
+            if (bounds.empty())
+                return;
+            int s1 = (bounds.br().y - 1) / stripHeight;
+            for (int s = bounds.y / stripHeight; s <= s1; ++s)
+                bins[s].push_back(&node);
+        });
+        if (!retained)
+            return false;
+
+        int const ss = std::max(1, supersampling);
+        bool const linear = (linearLight || ss > 1);
+
+        qcanvas strip;
+        strip.supersampling = ss;
+        strip.setScaleToFit(tree.getBoundingRect(), padding, cv::Size(size.width * ss, size.height * ss));
+
+        cv::Mat3b stripImage;
+        cv::Mat3f linearImage;
+        for (int s = 0; s < strips; ++s)
+        {
+            int y = s * stripHeight;
+            int rows = std::min(stripHeight, size.height - y);
+            strip.origin = cv::Point(0, y * ss);
+
+            if (linear)
+            {
+                linearImage.create(rows * ss, size.width * ss);
+                linearImage = cv::Vec3f(0.0f, 0.0f, 0.0f);
+                strip.image = linearImage;
+                TiledRenderer().render(tree, strip, bins[s]);
+                LinearLight::resolve(linearImage, ss, stripImage);
+            }
+            else
+            {
+                stripImage.create(rows, size.width);
+                stripImage = cv::Vec3b(0, 0, 0);
+                strip.image = stripImage;
+                TiledRenderer().render(tree, strip, bins[s]);
+            }
+
+            sink(stripImage, y);
+
+            // this strip's bin is no longer needed
+            std::vector<qnode const *>().swap(bins[s]);
+        }
+
+        return true;
+    }
+};
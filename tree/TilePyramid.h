@@ -0,0 +1,145 @@
+#pragma once
+
+
+#include "tree.h"
+#include "util.h"
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <filesystem>
+#include <atomic>
+#include <vector>
+
+
+namespace fs = std::filesystem;
+
+
+//  Multi-resolution XYZ tile pyramid: "{dir}/{z}/{x}/{y}.png", y down.
+//  Level z covers a square around the tree's bounding rect with 2^z x 2^z tiles.
+//  Levels are rendered top down; each tile's node list is culled from its parent's, tiles of a
+//  level are rendered in parallel, and tiles with no nodes are skipped along with everything below them.
+class TilePyramid
+{
+public:
+    int tileSize = 256;
+    int maxZoom = 6;
+
+    int tilesWritten = 0;
+    int tilesSkipped = 0;
+
+private:
+    struct Tile
+    {
+        int x, y;
+        std::vector<int> nodes;     // indices of nodes touching the tile, in drawing order
+    };
+
+public:
+
+    //  Returns false if the tree doesn't retain its nodes
+    bool render(qtree &tree, fs::path const &dir)
+    {
+        tilesWritten = 0;
+        tilesSkipped = 0;
+
+        // square domain, so tiles are square in model space too
+        cv::Rect_<float> rc = tree.getBoundingRect();
+        float side = std::max(rc.width, rc.height);
+        cv::Rect_<float> domain(rc.x + 0.5f * (rc.width - side), rc.y + 0.5f * (rc.height - side), side, side);
+
+        // model-space bounds of every node
+        std::vector<qnode const *> nodes;
+        std::vector<cv::Rect_<float> > bounds;
+        std::vector<cv::Point2f> pts;
+        bool retained = tree.forEachNode([&](qnode const &node)
+        {
+            util::polygon::transform(tree.getDrawPolygon(), pts, node.globalTransform);
+            if (pts.empty())
+                return;
+            nodes.push_back(&node);
+            bounds.push_back(util::getBoundingRect(pts));
+        });
+        if (!retained)
+            return false;
+
+        std::vector<Tile> level(1);
+        level[0] = Tile{ 0, 0, std::vector<int>(nodes.size()) };
+        for (int i = 0; i < (int)nodes.size(); ++i)
+            level[0].nodes[i] = i;
+
+        std::atomic<int> written = 0;
+        for (int z = 0; z <= maxZoom && !level.empty(); ++z)
+        {
+            int tiles = 1 << z;
+            qcanvas canvas;
+            canvas.setScaleToFit(domain, 0.0f, cv::Size(tiles * tileSize, tiles * tileSize));
+
+            // outline and antialiasing reach past the polygon by up to this much, in model units
+            float pad = (tree.lineThickness + 2) * side / (tiles * tileSize);
+            float tileSide = side / tiles;
+
+            std::vector<Tile> children(level.size() * 4);
+            util::parallelFor((int)level.size(), [&](int i)
+            {
+                Tile const &tile = level[i];
+                renderTile(tree, canvas, z, tile, nodes, dir);
+                ++written;
+
+                if (z == maxZoom)
+                    return;
+
+                // cull into the four children. model y is up, tile y is down
+                for (int k = 0; k < 4; ++k)
+                {
+                    Tile &child = children[4 * i + k];
+                    child.x = 2 * tile.x + (k & 1);
+                    child.y = 2 * tile.y + (k >> 1);
+
+                    float half = 0.5f * tileSide;
+                    cv::Rect_<float> area(
+                        domain.x + child.x * half - pad,
+                        domain.y + side - (child.y + 1) * half - pad,
+                        half + 2 * pad, half + 2 * pad);
+
+                    for (int n : tile.nodes)
+                        if ((bounds[n] & area).area() > 0.0f || area.contains(bounds[n].tl()))
+                            child.nodes.push_back(n);
+                }
+            });
+
+            std::vector<Tile> next;
+            for (auto &child : children)
+            {
+                if (!child.nodes.empty())
+                    next.push_back(std::move(child));
+                else if (z < maxZoom)
+                    tilesSkipped += ((1 << (2 * (maxZoom - z))) - 1) / 3;     // the child and everything below it
+            }
+            level.swap(next);
+        }
+
+        tilesWritten = written;
+        return true;
+    }
+
+private:
+
+    void renderTile(qtree &tree, qcanvas const &levelCanvas, int z, Tile const &tile, std::vector<qnode const *> const &nodes, fs::path const &dir) const
+    {
+        thread_local cv::Mat3b image;
+        image.create(tileSize, tileSize);
+        image = cv::Vec3b(0, 0, 0);
+
+        qcanvas canvas;
+        canvas.globalTransform = levelCanvas.globalTransform;
+        canvas.image = image;
+        canvas.origin = cv::Point(tile.x * tileSize, tile.y * tileSize);
+
+        for (int n : tile.nodes)
+            tree.drawNode(canvas, *nodes[n]);
+
+        fs::path path = dir / std::to_string(z) / std::to_string(tile.x);
+        std::error_code ec;     // tiles of the same column may race to create it
+        fs::create_directories(path, ec);
+        cv::imwrite((path / (std::to_string(tile.y) + ".png")).string(), image);
+    }
+};
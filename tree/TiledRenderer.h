@@ -0,0 +1,118 @@
+#pragma once
+
+
+#include "tree.h"
+#include "util.h"
+#include <vector>
+
+
+//  Parallel renderer for a stored set of nodes.
+//  Nodes are binned by screen-space bounding box into square tiles, and tiles are rasterized
+//  concurrently. Each tile draws its nodes in list order, so overlaps keep painter's order,
+//  into a scratch buffer covering the tile and a margin for outlines and antialiasing.
+//  Geometry is computed in full-image coordinates and offset by whole pixels, so a tile's pixels
+//  match a serial redraw of the list, except that coverage along edges crossing the scratch buffer's
+//  sides is split there in float: pixels next to tile seams may differ by 1 LSB.
+class TiledRenderer
+{
+public:
+    int tileSize = 256;
+
+    // below this many nodes, binning costs more than it saves: draw serially
+    size_t minParallelNodes = 2048;
+
+public:
+
+    void render(qtree &tree, qcanvas &canvas, std::vector<qnode const *> const &nodes) const
+    {
+        if (canvas.image.empty())
+            return;
+
+        if (nodes.size() < minParallelNodes)
+        {
+            for (auto pNode : nodes)
+                tree.drawNode(canvas, *pNode);
+            return;
+        }
+
+        cv::Rect imageRect(0, 0, canvas.image.cols, canvas.image.rows);
+        int cols = (imageRect.width + tileSize - 1) / tileSize;
+        int rows = (imageRect.height + tileSize - 1) / tileSize;
+
+        // bin nodes into every tile their bounds touch; each bin also tracks the union of its nodes' bounds
+        std::vector<std::vector<qnode const *> > bins(cols * rows);
+        std::vector<cv::Rect> binBounds(cols * rows);
+
+        for (auto pNode : nodes)
+        {
+            cv::Rect bounds = getNodeBounds(tree, canvas, *pNode) & imageRect;
+            if (bounds.empty())
+                continue;
+
+            int tx1 = (bounds.br().x - 1) / tileSize;
+            int ty1 = (bounds.br().y - 1) / tileSize;
+            for (int ty = bounds.y / tileSize; ty <= ty1; ++ty)
+            {
+                for (int tx = bounds.x / tileSize; tx <= tx1; ++tx)
+                {
+                    int i = ty * cols + tx;
+                    binBounds[i] = (bins[i].empty() ? bounds : (binBounds[i] | bounds));
+                    bins[i].push_back(pNode);
+                }
+            }
+        }
+
+        // margin for outline thickness and antialiasing, as getNodeBounds pads
+        int const pad = tree.lineThickness * canvas.supersampling + 2;
+
+        util::parallelFor(cols * rows, [&](int i)
+        {
+            if (bins[i].empty())
+                return;
+
+            // scratch covers the tile and its margin, where the bin's nodes touch them, so one large
+            // node doesn't make every tile it touches allocate and blend most of the frame
+            cv::Rect tile((i % cols) * tileSize, (i / cols) * tileSize, tileSize, tileSize);
+            cv::Rect scratchRect = cv::Rect(tile.x - pad, tile.y - pad, tile.width + 2 * pad, tile.height + 2 * pad) & binBounds[i];
+            // the part of the tile that any node in the bin can touch
+            cv::Rect tileRect = tile & scratchRect;
+            if (tileRect.empty())
+                return;
+
+            // only the tile's own pixels are seeded from (and copied back to) the canvas
+            thread_local cv::Mat scratchImage;
+            scratchImage.create(scratchRect.size(), canvas.image.type());
+            qcanvas scratch;
+            scratch.globalTransform = canvas.globalTransform;
+            scratch.image = scratchImage;
+            scratch.origin = canvas.origin + scratchRect.tl();
+            scratch.supersampling = canvas.supersampling;
+
+            cv::Rect tileInScratch = tileRect - scratchRect.tl();
+            canvas.image(tileRect).copyTo(scratch.image(tileInScratch));
+
+            for (auto pNode : bins[i])
+                tree.drawNode(scratch, *pNode);
+
+            scratch.image(tileInScratch).copyTo(canvas.image(tileRect));
+        });
+    }
+
+    //  Conservative pixel bounds of a node as drawn on {canvas}, in canvas image coordinates
+    static cv::Rect getNodeBounds(qtree const &tree, qcanvas const &canvas, qnode const &node)
+    {
+        thread_local std::vector<cv::Point2f> pts;
+        util::polygon::transform(tree.getDrawPolygon(), pts, NodeTransform(canvas.globalTransform) * node.globalTransform);
+        if (pts.empty())
+            return cv::Rect();
+
+        auto rc = util::getBoundingRect(pts);
+        // room for outline thickness and antialiasing
+        int pad = tree.lineThickness * canvas.supersampling + 2;
+        int x0 = (int)floor(rc.x) - pad - canvas.origin.x;
+        int y0 = (int)floor(rc.y) - pad - canvas.origin.y;
+        int x1 = (int)ceil(rc.x + rc.width) + pad + 1 - canvas.origin.x;
+        int y1 = (int)ceil(rc.y + rc.height) + pad + 1 - canvas.origin.y;
+        return cv::Rect(x0, y0, x1 - x0, y1 - y0);
+    }
+};
@@ -0,0 +1,234 @@
+#pragma once
+
+
+#include "tree.h"
+#include <opencv2/core/core.hpp>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+
+
+namespace fs = std::filesystem;
+
+
+//  Streaming vector writer: one filled (and optionally outlined) polygon per call, written straight
+//  to disk as it's produced, so memory use doesn't grow with the number of nodes.
+//  Coordinates are in page units, y down, matching qcanvas image coordinates.
+class VectorWriter
+{
+protected:
+    std::ofstream out;
+    cv::Size pageSize;
+    int lineThickness = 0;
+    cv::Scalar lineColor;       // 0-255 BGR, as in qtree
+
+    char buf[64];
+
+public:
+    virtual ~VectorWriter() {}
+
+    bool open(fs::path const &path, cv::Size size, cv::Scalar background, int lineThickness_, cv::Scalar lineColor_)
+    {
+        out.open(path, std::ios::out | std::ios::binary);
+        if (!out)
+            return false;
+
+        pageSize = size;
+        lineThickness = lineThickness_;
+        lineColor = lineColor_;
+        writeHeader(background);
+        return true;
+    }
+
+    //  Finishes the file. Returns false if anything failed to be written
+    bool close()
+    {
+        if (!out.is_open())
+            return false;
+
+        writeFooter();
+        out.flush();
+        bool ok = out.good();
+        out.close();
+        return ok && !out.fail();
+    }
+
+    //  {color} is 0-255 BGR
+    virtual void writePolygon(std::vector<cv::Point2f> const &pts, cv::Scalar color) = 0;
+
+protected:
+    virtual void writeHeader(cv::Scalar background) = 0;
+    virtual void writeFooter() = 0;
+
+    void writePoint(char const *format, cv::Point2f const &pt)
+    {
+        int n = sprintf_s(buf, format, pt.x, pt.y);
+        out.write(buf, n);
+    }
+
+    static uchar channel(cv::Scalar const &bgr, int i)
+    {
+        return cv::saturate_cast<uchar>(bgr(i));
+    }
+
+public:
+
+    //  Writes every retained node of {tree}, in drawing order, mapped onto a {size} page by {globalTransform}.
+    //  The format is chosen by extension: ".pdf" for PDF, anything else for SVG.
+    //  Returns false if the tree doesn't retain its nodes or the file can't be written.
+    static bool exportTree(qtree const &tree, Matx33 const &globalTransform, cv::Size size, fs::path const &path);
+};
+
+
+class SvgWriter : public VectorWriter
+{
+public:
+    virtual void writePolygon(std::vector<cv::Point2f> const &pts, cv::Scalar color) override
+    {
+        int n = sprintf_s(buf, "<polygon fill=\"#%02x%02x%02x\" points=\"", channel(color, 2), channel(color, 1), channel(color, 0));
+        out.write(buf, n);
+
+        for (auto const &pt : pts)
+            writePoint("%.2f,%.2f ", pt);
+
+        out << "\"/>\n";
+    }
+
+protected:
+    virtual void writeHeader(cv::Scalar background) override
+    {
+        out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << pageSize.width << "\" height=\"" << pageSize.height
+            << "\" viewBox=\"0 0 " << pageSize.width << " " << pageSize.height << "\">\n";
+
+        sprintf_s(buf, "#%02x%02x%02x", channel(background, 2), channel(background, 1), channel(background, 0));
+        out << "<rect width=\"100%\" height=\"100%\" fill=\"" << buf << "\"/>\n";
+
+        // stroke settings are shared by all nodes, so they're set once on the group
+        if (lineThickness > 0)
+        {
+            sprintf_s(buf, "#%02x%02x%02x", channel(lineColor, 2), channel(lineColor, 1), channel(lineColor, 0));
+            out << "<g stroke=\"" << buf << "\" stroke-width=\"" << lineThickness << "\" stroke-linejoin=\"round\">\n";
+        }
+        else
+        {
+            out << "<g stroke=\"none\">\n";
+        }
+    }
+
+    virtual void writeFooter() override
+    {
+        out << "</g>\n</svg>\n";
+    }
+};
+
+
+//  Single-page PDF with all nodes in one content stream.
+//  The stream length and the cross-reference table are written after the content,
+//  so nothing needs to be buffered. One page unit (point) per canvas pixel.
+class PdfWriter : public VectorWriter
+{
+    std::vector<std::streamoff> objectOffsets;
+    std::streamoff streamStart = 0;
+
+public:
+    virtual void writePolygon(std::vector<cv::Point2f> const &pts, cv::Scalar color) override
+    {
+        if (pts.empty())
+            return;
+
+        int n = sprintf_s(buf, "%.3f %.3f %.3f rg\n", channel(color, 2) / 255.0, channel(color, 1) / 255.0, channel(color, 0) / 255.0);
+        out.write(buf, n);
+
+        writePoint("%.2f %.2f m\n", pts[0]);
+        for (size_t i = 1; i < pts.size(); ++i)
+            writePoint("%.2f %.2f l\n", pts[i]);
+
+        // close path, then fill (f) or fill and stroke (B)
+        out << (lineThickness > 0 ? "h B\n" : "h f\n");
+    }
+
+protected:
+    void beginObject()
+    {
+        objectOffsets.push_back(out.tellp());
+        out << objectOffsets.size() << " 0 obj\n";
+    }
+
+    virtual void writeHeader(cv::Scalar background) override
+    {
+        objectOffsets.clear();
+        out << "%PDF-1.4\n";
+
+        beginObject();
+        out << "<< /Type /Catalog /Pages 2 0 R >>\nendobj\n";
+        beginObject();
+        out << "<< /Type /Pages /Kids [3 0 R] /Count 1 >>\nendobj\n";
+        beginObject();
+        out << "<< /Type /Page /Parent 2 0 R /MediaBox [0 0 " << pageSize.width << " " << pageSize.height << "] /Contents 4 0 R >>\nendobj\n";
+
+        // content stream; its length is written afterwards as object 5
+        beginObject();
+        out << "<< /Length 5 0 R >>\nstream\n";
+        streamStart = out.tellp();
+
+        // flip to y down, matching canvas coordinates
+        out << "1 0 0 -1 0 " << pageSize.height << " cm\n";
+
+        int n = sprintf_s(buf, "%.3f %.3f %.3f rg\n", channel(background, 2) / 255.0, channel(background, 1) / 255.0, channel(background, 0) / 255.0);
+        out.write(buf, n);
+        out << "0 0 " << pageSize.width << " " << pageSize.height << " re f\n";
+
+        if (lineThickness > 0)
+        {
+            n = sprintf_s(buf, "%.3f %.3f %.3f RG\n", channel(lineColor, 2) / 255.0, channel(lineColor, 1) / 255.0, channel(lineColor, 0) / 255.0);
+            out.write(buf, n);
+            out << lineThickness << " w 1 j\n";
+        }
+    }
+
+    virtual void writeFooter() override
+    {
+        std::streamoff streamLength = out.tellp() - streamStart;
+        out << "endstream\nendobj\n";
+
+        beginObject();
+        out << streamLength << "\nendobj\n";
+
+        std::streamoff xref = out.tellp();
+        out << "xref\n0 " << objectOffsets.size() + 1 << "\n0000000000 65535 f \n";
+        for (auto offset : objectOffsets)
+        {
+            // each entry is exactly 20 bytes
+            int n = sprintf_s(buf, "%010lld 00000 n \n", (long long)offset);
+            out.write(buf, n);
+        }
+
+        out << "trailer\n<< /Size " << objectOffsets.size() + 1 << " /Root 1 0 R >>\nstartxref\n" << xref << "\n%%EOF\n";
+    }
+};
+
+
+inline bool VectorWriter::exportTree(qtree const &tree, Matx33 const &globalTransform, cv::Size size, fs::path const &path)
+{
+    SvgWriter svg;
+    PdfWriter pdf;
+    VectorWriter &writer = (path.extension() == ".pdf") ? (VectorWriter &)pdf : (VectorWriter &)svg;
+
+    if (!writer.open(path, size, cv::Scalar(0, 0, 0), tree.lineThickness, tree.lineColor))
+        return false;
+
+    std::vector<cv::Point2f> pts;
+    bool retained = tree.forEachNode([&](qnode const &node)
+    {
+        util::polygon::transform(tree.getDrawPolygon(), pts, NodeTransform(globalTransform) * node.globalTransform);
+        writer.writePolygon(pts, 255.0 * node.bgr());
+    });
+
+    bool written = writer.close();
+
+    if (!retained || !written)
+        fs::remove(path);
+
+    return retained && written;
+}
@@ -1,4 +1,5 @@
-﻿#include <iostream>
+﻿#include "incommensurable_trig.h"
+#include <iostream>
 #include <iomanip>
 #include <random>
 #include <vector>
@@ -10,101 +11,13 @@ using std::cout;
 using std::endl;
 
 
-#pragma region iv<>: Incommensurable vector representation of trig values
-
-
-//  Exact trig computations for a finite subset of angles
-//  Computed via a vector of incommensurables
-//  div: Number of divisions of 90 degrees
-//  e.g. iv<16, 30> computes exact values for trig identities for multiples of 3 degrees.
-//  iv<16, 30>::sin(15) returns a vector representing the exact value of sin(45 degrees).
-template<int _N, int _AngleDiv>
-class iv
-{
-protected:
-    static const std::array<double, _N> s_icommValues;
-    static const std::array<iv<_N, _AngleDiv>, 1+_AngleDiv> s_sintable;
-
-public:
-    std::array<int, _N> values;
-
-    iv() { values.fill(0); }
-
-    iv(std::array<int, _N> const &v) { values = v; }
-
-    iv(std::initializer_list<int> const& list) {
-        if (list.size() == _N)
-        {
-            std::copy(list.begin(), list.end(), values.begin());
-        }
-    }
-
-    iv operator-() const {
-        std::array<int, _N> ret;
-        for (int i = 0; i < _N; ++i)
-            ret[i] = -values[i];
-        return ret;
-    }
-
-    void operator+=(iv<_N, _AngleDiv> const& v)
-    {
-        for (int i = 0; i < _N; ++i)
-            values[i] += v.values[i];
-    }
-
-    bool operator==(iv<_N, _AngleDiv> const& v)
-    {
-        for (int i = 0; i < _N; ++i)
-            if (values[i] != v.values[i])
-                return false;
-        return true;
-    }
-
-    operator double() const {
-        return std::inner_product(s_icommValues.begin(), s_icommValues.end(), values.begin(), 0.0);
-    }
-
-
-    static iv<_N, _AngleDiv> sin(int a);
-    static iv<_N, _AngleDiv> cos(int a);
-
-};
-
-
-#pragma region Templated trig fns: values from sine table
-
-template<int _N, int _AngleDiv>
-iv<_N, _AngleDiv> iv<_N, _AngleDiv>::cos(int a)
-{
-    a = ((a %= (4*_AngleDiv)) < 0) ? a + (4*_AngleDiv) : a;
-
-    if (a <= (1*_AngleDiv)) return  s_sintable[(1*_AngleDiv) - a];
-    if (a <= (2*_AngleDiv)) return -s_sintable[a - (1*_AngleDiv)];
-    if (a <= (3*_AngleDiv)) return -s_sintable[(3*_AngleDiv) - a];
-    return                          s_sintable[a - (3*_AngleDiv)];
-}
-
-template<int _N, int _AngleDiv>
-iv<_N, _AngleDiv> iv<_N, _AngleDiv>::sin(int a)
-{
-    a = ((a %= (4*_AngleDiv)) < 0) ? a + (4*_AngleDiv) : a;
-
-    if (a <= (1*_AngleDiv)) return  s_sintable[ a];
-    if (a <= (2*_AngleDiv)) return  s_sintable[ (2*_AngleDiv) - a];
-    if (a <= (3*_AngleDiv)) return -s_sintable[ a - (2*_AngleDiv)];
-    return                         -s_sintable[ (4*_AngleDiv) - a];
-}
-
-#pragma endregion
-
-
 #pragma region Template instantiations
 
 
 #pragma region iv<16, 30> (factors of 3 degrees)
 
 
-const std::array<double, 16> iv<16, 30>::s_icommValues = {
+template<> const std::array<double, 16> iv<16, 30>::s_icommValues = {
     0.1250000,      // 1/8
     0.0883883,      // √2/16
     0.2165064,      // √3/8
@@ -122,7 +35,7 @@ const std::array<double, 16> iv<16, 30>::s_icommValues = {
     0.5090370,
     0.8236391 };
 
-const std::array<iv<16, 30>, 31> iv<16, 30>::s_sintable = { {
+template<> const std::array<iv<16, 30>, 31> iv<16, 30>::s_sintable = { {
     {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0  },       // sin(0)
     {  0,-1, 0,-1, 0, 1, 0, 1, 0, 1, 0, 0, 0,-1, 0, 0  },
     { -1, 0, 0, 0,-1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0  },
@@ -160,7 +73,7 @@ const std::array<iv<16, 30>, 31> iv<16, 30>::s_sintable = { {
 
 #pragma region iv<8, 15> (factors of 6 degrees)
 
-const std::array<double, 8> iv<8, 15>::s_icommValues = {
+template<> const std::array<double, 8> iv<8, 15>::s_icommValues = {
     0.1250000,
     0.2165064,
     0.2795085,
@@ -170,7 +83,7 @@ const std::array<double, 8> iv<8, 15>::s_icommValues = {
     0.5090370,
     0.8236391 };
 
-const std::array<iv<8, 15>, 16> iv<8, 15>::s_sintable = { {
+template<> const std::array<iv<8, 15>, 16> iv<8, 15>::s_sintable = { {
     {  0, 0, 0, 0, 0, 0, 0, 0  },
     { -1, 0,-1, 0, 0, 0, 1, 0  },
     {  0, 1, 0,-1, 0, 1, 0, 0  },
@@ -194,12 +107,12 @@ const std::array<iv<8, 15>, 16> iv<8, 15>::s_sintable = { {
 #pragma region iv<2, 3> (factors of 30 degrees)
 
 
-const std::array<double, 2> iv<2, 3>::s_icommValues = {
+template<> const std::array<double, 2> iv<2, 3>::s_icommValues = {
     0.5,
     0.8660254       // √3/2
 };
 
-const std::array<iv<2, 3>, 4> iv<2, 3>::s_sintable = { {
+template<> const std::array<iv<2, 3>, 4> iv<2, 3>::s_sintable = { {
     {  0, 0  },
     {  1, 0  },     // sin(30) == 1/2
     {  0, 1  },     // sin(60) == √3/2
@@ -210,11 +123,11 @@ const std::array<iv<2, 3>, 4> iv<2, 3>::s_sintable = { {
 
 #pragma region iv<2, 2> (factors of 45 degrees)
 
-const std::array<double, 2> iv<2, 2>::s_icommValues = {
+template<> const std::array<double, 2> iv<2, 2>::s_icommValues = {
     1.0,
     0.7071068 };
 
-const std::array<iv<2, 2>, 3> iv<2, 2>::s_sintable = { {
+template<> const std::array<iv<2, 2>, 3> iv<2, 2>::s_sintable = { {
     {  0, 0  },
     {  0, 1  },
     {  1, 0  }
@@ -226,13 +139,10 @@ const std::array<iv<2, 2>, 3> iv<2, 2>::s_sintable = { {
 #pragma endregion
 
 
-#pragma endregion
-
-
 template<int _N, int _AngleDiv>
 void test()
 {
-    cout << "\nIV test: " << _AngleDiv << " divisions (" << (90 / _AngleDiv) << " degrees): exact representation as vector of size " << _N << endl;
+    cout << "\nIV test: " << _AngleDiv << " divisions (" << (90.0 / _AngleDiv) << " degrees): exact representation as vector of size " << _N << endl;
 
     iv<_N, _AngleDiv> zero;
     cout << "zero test: " << (double)zero << " iszero: " 
@@ -276,6 +186,7 @@ int runTests()
     test<8, 15>();
     test<2, 3>();
     test<2, 2>();
+    test<exact::totient(28), 7>();     // generated: heptagons
 
     return 0;
 }
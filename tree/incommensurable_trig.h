@@ -0,0 +1,566 @@
+#pragma once
+
+
+#include "util.h"
+#include <opencv2/core/core.hpp>
+#include <array>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+
+#pragma region iv<>: Incommensurable vector representation of trig values
+
+
+//  Exact trig computations for a finite subset of angles
+//  Computed via a vector of incommensurables
+//  div: Number of divisions of 90 degrees
+//  e.g. iv<16, 30> computes exact values for trig identities for multiples of 3 degrees.
+//  iv<16, 30>::sin(15) returns a vector representing the exact value of sin(45 degrees).
+//  The tabled divisions below have hand-built bases; any other division's basis and table are
+//  generated at compile time (see exact::ivSinTable), e.g. ivDiv<7> for multiples of 90/7 degrees.
+template<int _N, int _AngleDiv>
+class iv
+{
+protected:
+    static const std::array<double, _N> s_icommValues;
+    static const std::array<iv<_N, _AngleDiv>, 1+_AngleDiv> s_sintable;
+
+    //  s_sintable where tabled, otherwise the generated table
+    static std::array<iv<_N, _AngleDiv>, 1+_AngleDiv> const &sintable();
+
+public:
+    std::array<int, _N> values;
+
+    constexpr iv() : values{} {}
+
+    constexpr iv(std::array<int, _N> const &v) : values(v) {}
+
+    iv(std::initializer_list<int> const& list) {
+        if (list.size() == _N)
+        {
+            std::copy(list.begin(), list.end(), values.begin());
+        }
+    }
+
+    constexpr iv operator-() const {
+        std::array<int, _N> ret{};
+        for (int i = 0; i < _N; ++i)
+            ret[i] = -values[i];
+        return ret;
+    }
+
+    void operator+=(iv<_N, _AngleDiv> const& v)
+    {
+        for (int i = 0; i < _N; ++i)
+            values[i] += v.values[i];
+    }
+
+    bool operator==(iv<_N, _AngleDiv> const& v) const
+    {
+        for (int i = 0; i < _N; ++i)
+            if (values[i] != v.values[i])
+                return false;
+        return true;
+    }
+
+    operator double() const {
+        return std::inner_product(s_icommValues.begin(), s_icommValues.end(), values.begin(), 0.0);
+    }
+
+
+    static iv<_N, _AngleDiv> sin(int a);
+    static iv<_N, _AngleDiv> cos(int a);
+
+};
+
+
+#pragma region Templated trig fns: values from sine table
+
+template<int _N, int _AngleDiv>
+iv<_N, _AngleDiv> iv<_N, _AngleDiv>::cos(int a)
+{
+    a = ((a %= (4*_AngleDiv)) < 0) ? a + (4*_AngleDiv) : a;
+
+    if (a <= (1*_AngleDiv)) return  sintable()[(1*_AngleDiv) - a];
+    if (a <= (2*_AngleDiv)) return -sintable()[a - (1*_AngleDiv)];
+    if (a <= (3*_AngleDiv)) return -sintable()[(3*_AngleDiv) - a];
+    return                          sintable()[a - (3*_AngleDiv)];
+}
+
+template<int _N, int _AngleDiv>
+iv<_N, _AngleDiv> iv<_N, _AngleDiv>::sin(int a)
+{
+    a = ((a %= (4*_AngleDiv)) < 0) ? a + (4*_AngleDiv) : a;
+
+    if (a <= (1*_AngleDiv)) return  sintable()[ a];
+    if (a <= (2*_AngleDiv)) return  sintable()[ (2*_AngleDiv) - a];
+    if (a <= (3*_AngleDiv)) return -sintable()[ a - (2*_AngleDiv)];
+    return                         -sintable()[ (4*_AngleDiv) - a];
+}
+
+#pragma endregion
+
+
+// tables, in incommensurable_trig.cpp
+template<> const std::array<double, 16> iv<16, 30>::s_icommValues;
+template<> const std::array<iv<16, 30>, 31> iv<16, 30>::s_sintable;
+template<> const std::array<double, 8> iv<8, 15>::s_icommValues;
+template<> const std::array<iv<8, 15>, 16> iv<8, 15>::s_sintable;
+template<> const std::array<double, 2> iv<2, 3>::s_icommValues;
+template<> const std::array<iv<2, 3>, 4> iv<2, 3>::s_sintable;
+template<> const std::array<double, 2> iv<2, 2>::s_icommValues;
+template<> const std::array<iv<2, 2>, 3> iv<2, 2>::s_sintable;
+
+template<> inline std::array<iv<16, 30>, 31> const &iv<16, 30>::sintable() { return s_sintable; }
+template<> inline std::array<iv<8, 15>, 16> const &iv<8, 15>::sintable() { return s_sintable; }
+template<> inline std::array<iv<2, 3>, 4> const &iv<2, 3>::sintable() { return s_sintable; }
+template<> inline std::array<iv<2, 2>, 3> const &iv<2, 2>::sintable() { return s_sintable; }
+
+
+#pragma endregion
+
+
+#pragma region Cyclotomic integers: exact points and similarity transforms
+
+
+namespace exact
+{
+    constexpr int totient(int n)
+    {
+        int result = n;
+        for (int p = 2; p * p <= n; ++p)
+        {
+            if (n % p == 0)
+            {
+                while (n % p == 0)
+                    n /= p;
+                result -= result / p;
+            }
+        }
+        return (n > 1) ? result - result / n : result;
+    }
+
+    //  Moebius function: 0 if {n} has a square factor, else -1 to the number of its prime factors
+    constexpr int mobius(int n)
+    {
+        int result = 1;
+        for (int p = 2; p * p <= n; ++p)
+        {
+            if (n % p == 0)
+            {
+                n /= p;
+                if (n % p == 0)
+                    return 0;
+                result = -result;
+            }
+        }
+        return (n > 1) ? -result : result;
+    }
+
+    constexpr int divisorSum(int n)
+    {
+        int result = 0;
+        for (int d = 1; d <= n; ++d)
+            if (n % d == 0)
+                result += d;
+        return result;
+    }
+
+    //  Coefficients of the {n}th cyclotomic polynomial into p[0..totient(n)], lowest degree first:
+    //  the product over divisors d of {n} of (x^d - 1)^mobius(n/d).
+    //  {p} and {q} hold divisorSum(n) + 1 zeros each
+    constexpr void cyclotomicPolynomial(int n, long long *p, long long *q)
+    {
+        p[0] = 1;
+        int deg = 0;
+
+        // multiply by the numerator's factors...
+        for (int d = 1; d <= n; ++d)
+        {
+            if (n % d != 0 || mobius(n / d) != 1)
+                continue;
+            for (int k = deg + d; k >= 0; --k)
+                p[k] = ((k >= d) ? p[k - d] : 0) - p[k];
+            deg += d;
+        }
+
+        // ...then divide out the denominator's, each exactly, from the top
+        for (int d = 1; d <= n; ++d)
+        {
+            if (n % d != 0 || mobius(n / d) != -1)
+                continue;
+            deg -= d;
+            for (int k = deg; k >= 0; --k)
+                q[k] = p[k + d] + ((k + d <= deg) ? q[k + d] : 0);
+            for (int k = 0; k <= deg + d; ++k)
+                p[k] = (k <= deg) ? q[k] : 0;
+        }
+    }
+
+    //  At compile time, for the small {_N} of generated iv<> tables
+    template<int _N>
+    constexpr std::array<long long, totient(_N) + 1> cyclotomicPolynomial()
+    {
+        std::array<long long, divisorSum(_N) + 1> p{};
+        std::array<long long, divisorSum(_N) + 1> q{};
+        cyclotomicPolynomial(_N, p.data(), q.data());
+
+        std::array<long long, totient(_N) + 1> result{};
+        for (int k = 0; k <= totient(_N); ++k)
+            result[k] = p[k];
+        return result;
+    }
+
+    //  At run time. Not constexpr, so large {n} (840 takes millions of steps) is never attempted
+    //  at compile time in each translation unit
+    inline std::vector<long long> cyclotomicPolynomial(int n)
+    {
+        std::vector<long long> p(divisorSum(n) + 1), q(divisorSum(n) + 1);
+        cyclotomicPolynomial(n, p.data(), q.data());
+        p.resize(totient(n) + 1);
+        return p;
+    }
+
+    //  Reduces a[0..len) to degree < {degree} by {poly}, monic of that degree:
+    //  x^degree = -(lower terms of {poly})
+    constexpr void reduce(long long *a, int len, int degree, long long const *poly)
+    {
+        for (int k = len - 1; k >= degree; --k)
+        {
+            long long v = a[k];
+            if (v == 0)
+                continue;
+            a[k] = 0;
+            for (int j = 0; j < degree; ++j)
+                a[k - degree + j] -= v * poly[j];
+        }
+    }
+}
+
+
+//  An element of the cyclotomic integers Z[z], z = e^(2 pi i / {_N}): sums of integer multiples of
+//  powers of z, as exact complex numbers, i.e. points in the plane.
+//  Rotation by a multiple of 360/{_N} degrees is exact multiplication by a power of z, and unit steps
+//  at those angles sum to exact vertices. iv<> holds the real parts (the trig values) of such numbers;
+//  products need the imaginary parts too, so the ring here is the complex one they're drawn from.
+//  Stored reduced by the cyclotomic polynomial, so equal numbers have equal coefficients
+//  and compare exactly.
+template<int _N>
+class cyclotomic
+{
+public:
+    static constexpr int DEGREE = exact::totient(_N);
+
+    std::array<long long, DEGREE> c{};     // coefficients of 1, z, z^2, ...
+
+private:
+    static constexpr int BUFFER = std::max(2 * DEGREE - 1, _N);
+
+    //  computed once, at run time
+    static long long const *polynomial()
+    {
+        static std::vector<long long> const p = exact::cyclotomicPolynomial(_N);
+        return p.data();
+    }
+
+    //  reduces the first {len} coefficients of {a} to degree < DEGREE, and stores them
+    void reduce(std::array<long long, BUFFER> &a, int len)
+    {
+        exact::reduce(a.data(), len, DEGREE, polynomial());
+        for (int i = 0; i < DEGREE; ++i)
+            c[i] = a[i];
+    }
+
+public:
+    constexpr cyclotomic() {}
+
+    explicit constexpr cyclotomic(long long n) { c[0] = n; }
+
+    //  z^k
+    static cyclotomic root(int k)
+    {
+        std::array<long long, BUFFER> a{};
+        a[((k % _N) + _N) % _N] = 1;
+        cyclotomic r;
+        r.reduce(a, _N);
+        return r;
+    }
+
+    constexpr cyclotomic operator+(cyclotomic const &b) const
+    {
+        cyclotomic r;
+        for (int i = 0; i < DEGREE; ++i)
+            r.c[i] = c[i] + b.c[i];
+        return r;
+    }
+
+    constexpr cyclotomic operator-(cyclotomic const &b) const
+    {
+        cyclotomic r;
+        for (int i = 0; i < DEGREE; ++i)
+            r.c[i] = c[i] - b.c[i];
+        return r;
+    }
+
+    constexpr cyclotomic operator-() const
+    {
+        return cyclotomic() - *this;
+    }
+
+    cyclotomic operator*(cyclotomic const &b) const
+    {
+        std::array<long long, BUFFER> a{};
+        for (int i = 0; i < DEGREE; ++i)
+        {
+            if (c[i] == 0)
+                continue;
+            for (int j = 0; j < DEGREE; ++j)
+                a[i + j] += c[i] * b.c[j];
+        }
+        cyclotomic r;
+        r.reduce(a, 2 * DEGREE - 1);
+        return r;
+    }
+
+    //  complex conjugate: z^k -> z^-k. Reflects points over the x axis
+    cyclotomic conj() const
+    {
+        std::array<long long, BUFFER> a{};
+        for (int i = 0; i < DEGREE; ++i)
+            a[(_N - i) % _N] += c[i];
+        cyclotomic r;
+        r.reduce(a, _N);
+        return r;
+    }
+
+    constexpr bool operator==(cyclotomic const &b) const
+    {
+        for (int i = 0; i < DEGREE; ++i)
+            if (c[i] != b.c[i])
+                return false;
+        return true;
+    }
+    constexpr bool operator!=(cyclotomic const &b) const { return !(*this == b); }
+
+    //  the nearest point in double
+    cv::Point2d toPoint() const
+    {
+        static cv::Point2d const *roots = [] {
+            static cv::Point2d table[DEGREE];
+            for (int i = 0; i < DEGREE; ++i)
+            {
+                auto cs = util::transform3x3::cosSinDegrees(360.0 * i / _N);
+                table[i] = cv::Point2d(cs.first, cs.second);
+            }
+            return table;
+        }();
+
+        cv::Point2d p(0.0, 0.0);
+        for (int i = 0; i < DEGREE; ++i)
+            p += (double)c[i] * roots[i];
+        return p;
+    }
+};
+
+
+#pragma region Generated iv<> tables
+
+namespace exact
+{
+    //  Generated iv<> basis for {_AngleDiv} divisions of 90 degrees: with z = e^(2 pi i / (4 _AngleDiv)),
+    //  value {j} is half the real part of z^j. iv<> vectors are then the cyclotomic integers of twice
+    //  their values, reduced, so equal values have equal vectors.
+    template<int _N, int _AngleDiv>
+    constexpr std::array<double, _N> ivBasis()
+    {
+        std::array<double, _N> basis{};
+        for (int j = 0; j < _N; ++j)
+            basis[j] = 0.5 * util::transform3x3::cosSinDegrees(j * 90.0 / _AngleDiv).first;
+        return basis;
+    }
+
+    //  Generated sine table for ivBasis(): 2 sin(k * 90/_AngleDiv degrees) = z^(3 _AngleDiv + k) - z^(3 _AngleDiv - k),
+    //  reduced by the cyclotomic polynomial of 4 _AngleDiv
+    template<int _N, int _AngleDiv>
+    constexpr std::array<iv<_N, _AngleDiv>, 1 + _AngleDiv> ivSinTableUnchecked()
+    {
+        static_assert(_N == totient(4 * _AngleDiv), "generated iv<> tables have totient(4 * _AngleDiv) elements");
+
+        constexpr int N = 4 * _AngleDiv;
+        auto poly = cyclotomicPolynomial<N>();
+        std::array<iv<_N, _AngleDiv>, 1 + _AngleDiv> table{};
+        for (int k = 0; k <= _AngleDiv; ++k)
+        {
+            std::array<long long, N> a{};
+            a[(3 * _AngleDiv + k) % N] += 1;
+            a[3 * _AngleDiv - k] -= 1;
+            reduce(a.data(), N, _N, poly.data());
+            for (int j = 0; j < _N; ++j)
+                table[k].values[j] = (int)a[j];
+        }
+        return table;
+    }
+
+    //  true if every entry of the generated table evaluates to its sine, by the series cosSinDegrees() sums.
+    //  Large divisions may need the compiler's constexpr step limit raised (MSVC: /constexpr:steps)
+    template<int _N, int _AngleDiv>
+    constexpr bool verifyIvSinTable()
+    {
+        auto basis = ivBasis<_N, _AngleDiv>();
+        auto table = ivSinTableUnchecked<_N, _AngleDiv>();
+        for (int k = 0; k <= _AngleDiv; ++k)
+        {
+            double v = 0.0;
+            for (int j = 0; j < _N; ++j)
+                v += basis[j] * table[k].values[j];
+            double d = v - util::transform3x3::cosSinDegrees(k * 90.0 / _AngleDiv).second;
+            if (d > 1e-9 || d < -1e-9)
+                return false;
+        }
+        return true;
+    }
+
+    template<int _N, int _AngleDiv>
+    constexpr std::array<iv<_N, _AngleDiv>, 1 + _AngleDiv> ivSinTable()
+    {
+        static_assert(verifyIvSinTable<_N, _AngleDiv>(), "generated iv<> sine table doesn't match sin()");
+        return ivSinTableUnchecked<_N, _AngleDiv>();
+    }
+
+    template<int _N, int _AngleDiv>
+    inline constexpr std::array<iv<_N, _AngleDiv>, 1 + _AngleDiv> ivGeneratedSinTable = ivSinTable<_N, _AngleDiv>();
+}
+
+//  Divisions without a hand-built table use generated ones, computed at compile time
+template<int _N, int _AngleDiv>
+const std::array<double, _N> iv<_N, _AngleDiv>::s_icommValues = exact::ivBasis<_N, _AngleDiv>();
+
+template<int _N, int _AngleDiv>
+std::array<iv<_N, _AngleDiv>, 1+_AngleDiv> const &iv<_N, _AngleDiv>::sintable()
+{
+    return exact::ivGeneratedSinTable<_N, _AngleDiv>;
+}
+
+//  iv<> with a generated table for {_AngleDiv} divisions of 90 degrees
+template<int _AngleDiv>
+using ivDiv = iv<exact::totient(4 * _AngleDiv), _AngleDiv>;
+
+#pragma endregion
+
+
+//  Exact similarity transform of points in Z[z]: p -> f * p + t, or f * conj(p) + t if {mirror}.
+template<int _N>
+class ExactSimilarity
+{
+public:
+    cyclotomic<_N> f = cyclotomic<_N>(1);
+    cyclotomic<_N> t;
+    bool mirror = false;
+
+    cyclotomic<_N> operator()(cyclotomic<_N> const &p) const
+    {
+        return f * (mirror ? p.conj() : p) + t;
+    }
+
+    //  3x3 matrix, rounded once from the exact values
+    template<typename _Tp>
+    cv::Matx<_Tp, 3, 3> toMatx() const
+    {
+        cv::Point2d a = f.toPoint();
+        cv::Point2d b = t.toPoint();
+        double s = mirror ? -1.0 : 1.0;
+        return cv::Matx<_Tp, 3, 3>(
+            (_Tp)a.x, (_Tp)(-s * a.y), (_Tp)b.x,
+            (_Tp)a.y, (_Tp)(s * a.x), (_Tp)b.y,
+            0, 0, 1);
+    }
+};
+
+
+//  Polygon of unit edges, each at a multiple of 360/{_N} degrees, with exact vertices in Z[z]
+//  relative to its first vertex. Edge maps between its edges are exact similarity transforms.
+template<int _N>
+class ExactPolygon
+{
+    static_assert(_N % 2 == 0, "edge reversal needs a half turn");
+
+public:
+    cv::Point2d origin;                         // first vertex
+    std::vector<int> headings;                  // edge {i} runs from vertex {i} at heading {headings[i]} * 360/{_N}
+    std::vector<cyclotomic<_N> > vertices;      // relative to {origin}
+
+    //  Recognizes {polygon} if all its edges are of unit length at multiples of 360/{_N} degrees,
+    //  to within {tolerance}, and they close exactly. Returns false if not.
+    template<typename _Tp>
+    bool fromPolygon(std::vector<cv::Point_<_Tp> > const &polygon, double tolerance = 1e-4)
+    {
+        headings.clear();
+        vertices.clear();
+        if (polygon.size() < 3)
+            return false;
+
+        origin = cv::Point2d(polygon[0].x, polygon[0].y);
+        cyclotomic<_N> v;
+        for (size_t i = 0; i < polygon.size(); ++i)
+        {
+            cv::Point2d d = cv::Point2d(polygon[(i + 1) % polygon.size()].x, polygon[(i + 1) % polygon.size()].y)
+                - cv::Point2d(polygon[i].x, polygon[i].y);
+            if (std::abs(std::sqrt(d.dot(d)) - 1.0) > tolerance)
+                return false;
+
+            double steps = std::atan2(d.y, d.x) * _N / CV_2PI;
+            int h = (int)std::lround(steps);
+            if (std::abs(steps - h) * CV_2PI / _N > tolerance)
+                return false;
+
+            headings.push_back(((h % _N) + _N) % _N);
+            vertices.push_back(v);
+            v = v + cyclotomic<_N>::root(h);
+        }
+        return v == cyclotomic<_N>();
+    }
+
+    //  The transform that maps edge {childEdge} onto edge {parentEdge} as qtree::createEdgeTransform does:
+    //  reversed, so tiles meet along it, or reflected over it if {mirror}. Relative to {origin}.
+    ExactSimilarity<_N> edgeMap(int parentEdge, int childEdge, bool mirror) const
+    {
+        int n = (int)vertices.size();
+        auto const &c0 = vertices[childEdge];
+        auto const &p0 = vertices[parentEdge];
+        auto const &p1 = vertices[(parentEdge + 1) % n];
+
+        ExactSimilarity<_N> s;
+        s.mirror = mirror;
+        if (mirror)
+        {
+            // child edge direction, reflected, onto the parent's; c0 -> p0
+            s.f = cyclotomic<_N>::root(headings[parentEdge] + headings[childEdge]);
+            s.t = p0 - s.f * c0.conj();
+        }
+        else
+        {
+            // child edge direction onto the parent's reversed; c0 -> p1
+            s.f = cyclotomic<_N>::root(headings[parentEdge] + _N / 2 - headings[childEdge]);
+            s.t = p1 - s.f * c0;
+        }
+        return s;
+    }
+
+    //  {s}, a transform relative to {origin}, as a 3x3 matrix on the polygon's own coordinates
+    template<typename _Tp>
+    cv::Matx<_Tp, 3, 3> toMatx(ExactSimilarity<_N> const &s) const
+    {
+        cv::Matx<double, 3, 3> m = s.template toMatx<double>();
+        cv::Matx<double, 3, 3> m2 = util::transform3x3::getTranslate(origin.x, origin.y) * m * util::transform3x3::getTranslate(-origin.x, -origin.y);
+        return cv::Matx<_Tp, 3, 3>(
+            (_Tp)m2(0, 0), (_Tp)m2(0, 1), (_Tp)m2(0, 2),
+            (_Tp)m2(1, 0), (_Tp)m2(1, 1), (_Tp)m2(1, 2),
+            0, 0, 1);
+    }
+};
+
+
+#pragma endregion
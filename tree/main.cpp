@@ -1,11 +1,31 @@
 #include "treedemo.h"
 #include <opencv2/highgui/highgui.hpp>
 #include <thread>
+#include <atomic>
 #include <conio.h>
+#ifdef _DEBUG
+#include <crtdbg.h>
+#endif
 
 
 TreeDemo the;
 
+
+#ifdef _DEBUG
+#pragma region Allocation counter
+
+//  Debug heap hook: counts heap allocations made while processing nodes (TreeDemo::countingAllocations),
+//  so each run can report allocations per node without the UI's. Debug builds only
+static int __cdecl countGrowthAllocations(int allocType, void *, size_t, int, long, unsigned char const *, int)
+{
+    if (allocType == _HOOK_ALLOC && TreeDemo::countingAllocations)
+        ++TreeDemo::growthAllocations;
+    return TRUE;
+}
+
+#pragma endregion
+#endif
+
 #pragma region OpenCV HighGUI callbacks
 
 static void onMouse(int event, int x, int y, int, void*)
@@ -31,21 +51,19 @@ static void onMouse(int event, int x, int y, int, void*)
     return;
 
     // delete block
-    the.pTree->getNodesIntersecting(cv::Rect2f(pt, cv::Size2f(11, 8)), nodes);
-    for (auto &node : nodes)
-    {
-        the.pTree->removeNode(node.id);
-    }
-    the.pTree->redrawAll(the.canvas);
-    cv::imshow("Memtest", the.canvas.image); // Show our image inside it.
+    the.removeNodes(cv::Rect2f(pt, cv::Size2f(11, 8)));
+    cv::imshow("Memtest", the.snapshots.acquire().image); // Show our image inside it.
 }
 
 #pragma endregion
 
 
+//  shows the latest published frame; the canvas itself may be mid-draw on the worker thread
 void redrawCallback()
 {
-    imshow("Memtest", the.canvas.image); // Show our image inside it.
+    auto const &frame = the.snapshots.acquire();
+    if (!frame.image.empty())
+        imshow("Memtest", frame.image); // Show our image inside it.
     auto key = cv::waitKey(1);   // allows redraw
 }
 
@@ -58,6 +76,10 @@ int main(int argc, char** argv)
         return -1;
     }
 
+#ifdef _DEBUG
+    _CrtSetAllocHook(countGrowthAllocations);
+#endif
+
     cv::namedWindow("Memtest", cv::WindowFlags::WINDOW_AUTOSIZE); // Create a window for display.
 
     cv::setMouseCallback("Memtest", onMouse, 0);
@@ -67,11 +89,18 @@ int main(int argc, char** argv)
     //  Main console program loop
     while (!the.m_quit)
     {
+        size_t allocationsAtStart = TreeDemo::growthAllocations;
+        int nodesAtStart = the.totalNodesProcessed;
+
         redrawCallback();
 
         while (the.isWorkerTaskRunning() && !::_kbhit())
         {
-            cv::imshow("Memtest", the.canvas.image); // Show our image inside it.
+            // show the latest completed frame; HighGUI only shows whole images, so unchanged frames are skipped
+            bool isNew;
+            auto const &frame = the.snapshots.acquire(&isNew);
+            if (isNew && !frame.image.empty())
+                cv::imshow("Memtest", frame.image); // Show our image inside it.
             cv::waitKey(1);
 
             using namespace std::chrono_literals;
@@ -81,6 +110,12 @@ int main(int argc, char** argv)
         if (the.pTree->nodeQueue.empty())
         {
             the.showReport(0.0);
+#ifdef _DEBUG
+            // includes node storage: retaining trees keep each accepted node in a list
+            size_t allocations = TreeDemo::growthAllocations - allocationsAtStart;
+            int nodes = the.totalNodesProcessed - nodesAtStart;
+            cout << allocations << " heap allocations (" << (nodes > 0 ? (double)allocations / nodes : 0.0) << "/node)\n";
+#endif
             cout << "Run complete.\n";
 
             the.showCommands();
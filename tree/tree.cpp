@@ -1,4 +1,5 @@
 #include "tree.h"
+#include "incommensurable_trig.h"
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc.hpp>
 #include <vector>
@@ -14,16 +15,20 @@ bool qtree::process()
     nodeQueue.pop();
 
     if (!isViable(currentNode))
+    {
+        rejectNode(currentNode);
         return false;
+    }
 
     addNode(currentNode);
 
     // create a child node for each available transform.
     // all child nodes are added to the queue, even if not viable.
-    for (auto const &t : transforms)
+    for (int i = 0; i < (int)transforms.size(); ++i)
     {
         qnode child;
-        beget(currentNode, t, child);
+        beget(currentNode, transforms[i], child);
+        child.transformIndex = i;
         assert(currentNode.id == 0 || currentNode.parentId < currentNode.id);
         nodeQueue.push(child);
     }
@@ -48,20 +53,43 @@ void qtree::beget(qnode const & parent, qtransform const & t, qnode & child)
 
     child.beginTime = parent.beginTime + t.gestation + (gestationRandomness>0.0 ? r(gestationRandomness) : 0.0);
 
-    child.globalTransform = parent.globalTransform * t.transformMatrix;
+    child.globalTransform = parent.globalTransform * NodeTransform(t.transformMatrix);
 
-    child.color = t.colorTransform.apply(parent.color);
+    child.colorSpace = parent.colorSpace;
+    child.color = t.colorTransform.apply(parent.color, child.colorSpace);
 }
 
 
-//  Node draw function for tree of nodes with all the same polygon
+//  Node draw function for tree of nodes with all the same polygon.
+//  Node colors are converted to BGR here, once per draw, rather than at each generation
 void qtree::drawNode(qcanvas &canvas, qnode const &node)
 {
     cv::Scalar color =
-        //(node.det() < 0) ? 255.0 * (cv::Scalar(1.0, 1.0, 1.0, 1.0) - node.color) : 
-        255.0 * node.color;
+        //(node.det() < 0) ? 255.0 * (cv::Scalar(1.0, 1.0, 1.0, 1.0) - node.bgr()) : 
+        255.0 * node.bgr();
+
+    canvas.fillPoly(getDrawPolygon(), node.globalTransform, color, lineThickness, lineColor);
+}
+
+
+//  Edge map of {polygon} computed exactly and rounded once, if it's a polygon of unit edges at multiples
+//  of 3/7 degree. Its exact form is kept per thread, and rebuilt when the polygon changes
+bool qtree::getExactEdgeMap(int parentEdge, int childEdge, bool mirror, NodeMatx33 &m) const
+{
+    thread_local std::vector<cv::Point2f> source;
+    thread_local ExactPolygon<840> exactPolygon;
+    thread_local bool isExact = false;
+
+    if (polygon != source)
+    {
+        source = polygon;
+        isExact = exactPolygon.fromPolygon(polygon);
+    }
+    if (!isExact)
+        return false;
 
-    canvas.fillPoly(polygon, node.globalTransform, 255.0 * node.color, lineThickness, lineColor);
+    m = exactPolygon.toMatx<NodeMatx33::value_type>(exactPolygon.edgeMap(parentEdge, childEdge, mirror));
+    return true;
 }
 
 
@@ -1,6 +1,9 @@
 #pragma once
 
+#include "AffineTransform.h"
 #include "ColorTransform.h"
+#include "CoverageRasterizer.h"
+#include "LinearLight.h"
 #include "util.h"
 #include <opencv2/core/core.hpp>
 #include <vector>
@@ -10,6 +13,7 @@
 #include <nlohmann/json.hpp>
 #include <iostream>
 #include <unordered_map>
+#include <functional>
 
 
 using json = nlohmann::basic_json<>;
@@ -37,6 +41,13 @@ class qcanvas
 public:
     Matx33 globalTransform;
     cv::Mat image;
+    // position of {image} within the full rendered image, for canvases that cover only a tile of it.
+    // globalTransform always maps to full-image coordinates.
+    cv::Point origin;
+    // regions of {image} drawn since the last takeDirtyRects(), in image coordinates
+    std::vector<cv::Rect> dirtyRects;
+    // image pixels per output pixel, for supersampled canvases. line widths are scaled by it
+    int supersampling = 1;
 
     qcanvas() {
     }
@@ -44,6 +55,25 @@ public:
     void create(cv::Mat im)
     {
         image = im;
+        invalidate();
+    }
+
+    //  Marks the whole image as changed, e.g. after it's cleared or replaced
+    void invalidate()
+    {
+        dirtyRects.assign(1, cv::Rect(0, 0, image.cols, image.rows));
+    }
+
+    void addDirtyRect(cv::Rect const &rc)
+    {
+        util::addRegion(dirtyRects, rc & cv::Rect(0, 0, image.cols, image.rows));
+    }
+
+    //  Moves the accumulated dirty regions into {rects}, leaving none pending
+    void takeDirtyRects(std::vector<cv::Rect> &rects)
+    {
+        rects.clear();
+        rects.swap(dirtyRects);
     }
 
     // sets global transform map to map provided domain to image, centered, vertically flipped
@@ -51,7 +81,13 @@ public:
     {
         if (image.empty()) throw std::exception("Image is empty");
 
-        globalTransform = util::transform3x3::centerAndFit(rect, cv::Rect_<float>(0.0f, 0.0f, (float)image.cols, (float)image.rows), buffer, true);
+        setScaleToFit(rect, buffer, image.size());
+    }
+
+    // as above, for a full image of {fullSize}, of which this canvas may hold only a part
+    void setScaleToFit(cv::Rect_<float> const &rect, float buffer, cv::Size fullSize)
+    {
+        globalTransform = util::transform3x3::centerAndFit(rect, cv::Rect_<float>(0.0f, 0.0f, (float)fullSize.width, (float)fullSize.height), buffer, true);
     }
 
     cv::Point2f canvasToModel(cv::Point2f pt)
@@ -61,24 +97,61 @@ public:
         return cv::Point2f(t.x, t.y);
     }
 
-    void fillPoly(std::vector<cv::Point2f> const &polygon, Matx33 const &transform, cv::Scalar color, int lineThickness, cv::Scalar lineColor)
+    //  {color} and {lineColor} are 0-255 BGR. Float canvases hold linear light, and get the colors converted to it
+    void fillPoly(std::vector<cv::Point2f> const &polygon, NodeTransform const &transform, cv::Scalar color, int lineThickness, cv::Scalar lineColor)
     {
-        Matx33 m = globalTransform * transform;
+        NodeTransform m = NodeTransform(globalTransform) * transform;
+        lineThickness *= supersampling;
+
+        // per-thread scratch buffers, reused from node to node
+        thread_local vector<cv::Point2f> v;
+        thread_local vector<cv::Point> pts;
 
-        vector<cv::Point2f> v;
-        cv::transform(polygon, v, m.get_minor<2, 3>(0, 0));
-        vector<vector<cv::Point> > pts(1);
-        for (auto const& p : v)
-            pts[0].push_back(p * 16);
+        util::polygon::transform(polygon, v, m);
+
+        if (image.type() == CV_8UC3)
+        {
+            // analytic coverage: fill and outline anti-aliased together in one pass
+            thread_local CoverageRasterizer rasterizer;
+            cv::Mat3b im = image;
+            addDirtyRect(rasterizer.draw(im, origin, v, color, lineThickness, lineColor));
+            return;
+        }
+
+        if (image.type() == CV_32FC3)
+        {
+            thread_local CoverageRasterizer rasterizer;
+            cv::Mat3f im = image;
+            addDirtyRect(rasterizer.draw(im, origin, v, LinearLight::toLinear(color), lineThickness, LinearLight::toLinear(lineColor)));
+            return;
+        }
+
+        pts.resize(v.size());
+        cv::Point const offset = origin * 16;
+        for (size_t i = 0; i < v.size(); ++i)
+        {
+            pts[i] = v[i] * 16;
+            pts[i] -= offset;
+        }
+
+        cv::Point const *ppts = pts.data();
+        int npts = (int)pts.size();
+
+        if (!v.empty())
+        {
+            int pad = lineThickness + 1;
+            cv::Rect_<float> rc = util::getBoundingRect(v);
+            addDirtyRect(cv::Rect((int)floor(rc.x) - pad - origin.x, (int)floor(rc.y) - pad - origin.y, (int)ceil(rc.width) + 2 * pad + 2, (int)ceil(rc.height) + 2 * pad + 2));
+        }
 
         if (lineThickness > 0)
         {
-            cv::fillPoly(image, pts, color, cv::LineTypes::LINE_8, 4);
-            cv::polylines(image, pts, true, lineColor, lineThickness, cv::LineTypes::LINE_AA, 4);
+            cv::fillPoly(image, &ppts, &npts, 1, color, cv::LineTypes::LINE_8, 4);
+            cv::polylines(image, &ppts, &npts, 1, true, lineColor, lineThickness, cv::LineTypes::LINE_AA, 4);
         }
         else
         {
-            cv::fillPoly(image, pts, color, cv::LineTypes::LINE_AA, 4);
+            cv::fillPoly(image, &ppts, &npts, 1, color, cv::LineTypes::LINE_AA, 4);
         }
     }
 
@@ -89,20 +162,20 @@ class qtransform
 {
 public:
     string transformMatrixKey;
-    Matx33 transformMatrix;
+    NodeMatx33 transformMatrix;     // in node precision, so double-precision lineages aren't rounded to float each generation
     ColorTransform colorTransform;
     double gestation;
 
 public:
 
-    qtransform(Matx33 const &transformMatrix_ = Matx33::eye(), ColorTransform const &colorTransform_ = ColorTransform(), double gestation_ = 1.0)
+    qtransform(NodeMatx33 const &transformMatrix_ = NodeMatx33::eye(), ColorTransform const &colorTransform_ = ColorTransform(), double gestation_ = 1.0)
     {
         transformMatrix = transformMatrix_;
         colorTransform = colorTransform_;
         gestation = gestation_;
     }
 
-    qtransform(string key_, Matx33 const &transformMatrix_ = Matx33::eye(), ColorTransform const &colorTransform_ = ColorTransform(), double gestation_ = 1.0)
+    qtransform(string key_, NodeMatx33 const &transformMatrix_ = NodeMatx33::eye(), ColorTransform const &colorTransform_ = ColorTransform(), double gestation_ = 1.0)
     {
         transformMatrixKey = key_;
         transformMatrix = transformMatrix_;
@@ -113,14 +186,14 @@ public:
     template<typename _Tp>
     qtransform(_Tp m00, _Tp m01, _Tp mtx, _Tp m10, _Tp m11, _Tp mty, ColorTransform const &colorTransform_)
     {
-        transformMatrix = Matx33(m00, m01, mtx, m10, m11, mty, 0, 0, 1);
+        transformMatrix = NodeMatx33(m00, m01, mtx, m10, m11, mty, 0, 0, 1);
         colorTransform = colorTransform_;
         gestation = 1.0;
     }
 
     qtransform(double angle, double scale, cv::Point2f translate)
     {
-        transformMatrix = util::transform3x3::getRotationMatrix2D(Point2f(), angle, scale, translate.x, translate.y);
+        transformMatrix = util::transform3x3::getRotationMatrix2D<NodeMatx33::value_type>(cv::Point_<NodeMatx33::value_type>(), angle, scale, translate.x, translate.y);
         //colorTransform = colorTransform.eye();
         //colorTransform(2, 2) = 0.94f;
         //colorTransform(1, 1) = 0.96f;
@@ -177,10 +250,12 @@ class qnode
 public:
     int         id              = 0;
     int         parentId        = 0;
+    int         transformIndex  = -1;   // index in qtree::transforms of the transform that begot this node; -1 for roots
     string      sourceTransform;
     double      beginTime       = 0.0;
-    Matx33      globalTransform;
+    NodeTransform globalTransform;
     cv::Scalar  color = cv::Scalar(1.0, 0.5, 0.0, 1.0);
+    ColorSpace  colorSpace      = ColorSpace::BGR;  // roots are colored in BGR; begotten nodes carry their color transform's space
 
 
     qnode(int id_=0, int parentId_=0, double beginTime_ = 0)
@@ -192,7 +267,10 @@ public:
         globalTransform = globalTransform.eye();
     }
 
-    inline float det() const { return (globalTransform(0, 0) * globalTransform(1, 1) - globalTransform(0, 1) * globalTransform(1, 0)); }
+    //  {color} as 0.0-1.0 BGR, for drawing
+    inline cv::Scalar bgr() const { return (colorSpace == ColorSpace::HLS) ? util::hls2bgr(color) : color; }
+
+    inline double det() const { return globalTransform.det(); }
 
     inline bool operator!() const { return !( fabs(det()) > 1e-5 ); }
 
@@ -254,6 +332,9 @@ public:
     // stats
     std::unordered_map<string, int> transformCounts;
 
+private:
+    bool getExactEdgeMap(int parentEdge, int childEdge, bool mirror, NodeMatx33 &m) const;
+
 public:
     qtree() {}
 
@@ -399,12 +480,15 @@ public:
     // invoked when a viable node is pulled from the queue. override to update drawing, data structures, etc.
     virtual void addNode(qnode & node);
 
+    // invoked when a node pulled from the queue is not viable and is discarded
+    virtual void rejectNode(qnode const & node) {}
+
     virtual void getNodesIntersecting(cv::Rect2f const &rect, std::vector<qnode> &nodes) const {}
 
     // convenience fn: get node's polygon in model coordinates
     virtual void getPolyPoints(qnode const &node, std::vector<cv::Point2f> &transformedPoints) const
     {
-        cv::transform(polygon, transformedPoints, node.globalTransform.get_minor<2, 3>(0, 0));
+        util::polygon::transform(polygon, transformedPoints, node.globalTransform);
     }
 
     virtual int removeNode(int id) { return 0; }
@@ -418,6 +502,10 @@ public:
     // trigger all existing nodes to attempt to re-bud child nodes
     virtual void regrowAll() {}
 
+    // re-derives node colors along each node's lineage after color transforms change, without regrowing.
+    // returns false if this tree doesn't retain its nodes
+    virtual bool recolorAll() { return false; }
+
     virtual cv::Rect_<float> getBoundingRect() const
     {
         return domain;
@@ -436,9 +524,20 @@ public:
         }
     }
 
-    virtual void redrawAll(qcanvas &canvas) {}
+    // redraws all nodes onto a cleared canvas of any size, without re-simulating.
+    // returns false if this tree doesn't retain its nodes, in which case only a restart can redraw it
+    virtual bool redrawAll(qcanvas &canvas) { return false; }
+
+    // calls fn for each retained node, in drawing order.
+    // returns false if this tree doesn't retain its nodes
+    virtual bool forEachNode(std::function<void(qnode const &)> const &fn) const { return false; }
+
+    // draws one node. must not modify the model: redraws call this concurrently for different tiles
     virtual void drawNode(qcanvas &canvas, qnode const &node);
 
+    // polygon drawn for each node, in node coordinates
+    virtual std::vector<cv::Point2f> const &getDrawPolygon() const { return polygon; }
+
     virtual void saveImage(fs::path imagePath) { };
 
     virtual void combineWith(qtree const &tree, double a)
@@ -542,12 +641,26 @@ public:
             parentEdgeString += (string("[") + std::to_string(ratio0) + ":" + std::to_string(ratio1) + "]");
         auto childEdgeString  = string("E") + std::to_string(childEdge);
 
-        auto p0 = polygon[parentEdge];
-        auto p1 = polygon[(parentEdge + 1) % polygon.size()];
-        auto midPt0 = (1.0f - ratio0) * p0 + ratio0 * p1;
-        auto midPt1 = (1.0f - ratio1) * p0 + ratio1 * p1;
-        auto c0 = polygon[childEdge];
-        auto c1 = polygon[(childEdge + 1) % polygon.size()];
+        // maps are computed in node precision
+        typedef cv::Point_<NodeMatx33::value_type> EdgePoint;
+        EdgePoint p0 = polygon[parentEdge];
+        EdgePoint p1 = polygon[(parentEdge + 1) % polygon.size()];
+        EdgePoint midPt0 = (1.0f - ratio0) * p0 + ratio0 * p1;
+        EdgePoint midPt1 = (1.0f - ratio1) * p0 + ratio1 * p1;
+        EdgePoint c0 = polygon[childEdge];
+        EdgePoint c1 = polygon[(childEdge + 1) % polygon.size()];
+
+        // polygons of unit edges at multiples of 3/7 degree (regular polygons and stars of up to 8 points)
+        // get edge maps computed exactly and rounded once, rather than from the rounded vertices.
+        // Lineages still compose them in NodeTransform precision.
+        NodeMatx33 exactMap;
+        if (ratio0 == 0.0f && ratio1 == 1.0f && getExactEdgeMap(parentEdge, childEdge, mirror, exactMap))
+        {
+            return qtransform(
+                parentEdgeString + (mirror ? ":-" : ":+") + childEdgeString,
+                exactMap
+            );
+        }
 
         if (mirror)
         {
@@ -101,10 +101,14 @@ bool TreeDemo::endStepMode()
 
 void TreeDemo::sendProgressUpdate()
 {
+    canvas.takeDirtyRects(m_dirtyRects);
+    snapshots.publish(canvas.image, m_dirtyRects);
+    recorder.capture(canvas.image, totalNodesProcessed, modelTime);
+
     if (!!m_progressCallback)
     {
         //std::unique_lock<std::mutex> lock(demo_mutex);
-        m_quit |= m_progressCallback(1, totalNodesProcessed);
+        m_quit |= m_progressCallback(1, totalNodesProcessed, m_dirtyRects);
     }
     else
     {
@@ -115,6 +119,7 @@ void TreeDemo::sendProgressUpdate()
 int TreeDemo::processNodes()
 {
     int nodesProcessed = 0;
+    countingAllocations = true;
     while (!pTree->nodeQueue.empty()
         && nodesProcessed < maxNodesProcessedPerFrame
         //&& pTree->nodeQueue.top().det() >= cutoff 
@@ -127,6 +132,7 @@ int TreeDemo::processNodes()
         if (!pTree->isViable(currentNode))
         {
             pTree->nodeQueue.pop();
+            pTree->rejectNode(currentNode);
             continue;
         }
 
@@ -136,6 +142,7 @@ int TreeDemo::processNodes()
         pTree->process();
         modelTime = currentNode.beginTime + 1.0;
     }
+    countingAllocations = false;
 
     totalNodesProcessed += nodesProcessed;
 
@@ -152,6 +159,62 @@ void TreeDemo::restart(bool randomize)
     processCommands();
 }
 
+//  Re-renders the current model onto a new canvas at {renderSize} without re-simulating.
+//  Trees that don't retain their nodes are restarted instead.
+void TreeDemo::redraw()
+{
+    endWorkerTask();
+
+    canvas.image = cv::Mat3b(renderSize);
+    canvas.image = 0;
+    canvas.setScaleToFit(pTree->getBoundingRect(), imagePadding);
+
+    if (!pTree->redrawAll(canvas))
+    {
+        restart();
+        return;
+    }
+
+    sendProgressUpdate();
+
+    if (!m_stepping && !pTree->nodeQueue.empty())
+    {
+        startWorkerTask();
+    }
+}
+
+//  Removes the nodes intersecting {modelRect} with growth paused, then redraws and publishes the canvas.
+//  Returns the number of nodes removed.
+int TreeDemo::removeNodes(cv::Rect2f const &modelRect)
+{
+    endWorkerTask();
+
+    std::vector<qnode> nodes;
+    pTree->getNodesIntersecting(modelRect, nodes);
+
+    int count = 0;
+    for (auto &node : nodes)
+        count += pTree->removeNode(node.id);
+
+    redraw();
+    return count;
+}
+
+//  Re-derives node colors after a palette change and redraws, without re-simulating.
+//  Trees that don't retain their nodes are restarted instead.
+void TreeDemo::recolor()
+{
+    endWorkerTask();
+
+    if (!pTree->recolorAll())
+    {
+        restart();
+        return;
+    }
+
+    redraw();
+}
+
 void TreeDemo::processCommands()
 {
     //std::unique_lock<std::mutex> lock(demo_mutex);
@@ -186,6 +249,7 @@ void TreeDemo::processCommands()
 
         canvas.image = cv::Mat3b(renderSize);
         canvas.image = 0;
+        canvas.invalidate();
         canvas.setScaleToFit(pTree->getBoundingRect(), imagePadding);
 
 
@@ -210,7 +274,8 @@ void TreeDemo::processCommands()
 
 void TreeDemo::showCommands()
 {
-    cout << "| 'q' quit, 's' save, 'o',PgUp,PgDn open, 'C',' ' restart, '.'/',' step/continue, 'r' randomize, 'c' color, 'l' line color, 'p' polygon,\n"
+    cout << "| 'q' quit, 's' save, 'E'/'G'/'Z' export hi-res/gigapixel/tiles, 'V'/'F' export SVG/PDF, 'v' record, 'o',PgUp,PgDn open, 'C',' ' restart, '.'/',' step/continue, 'r' randomize, 'c' color, 'l' line color, 'p' polygon,\n"
+        << "| 'h' HD/preview,\n"
         << "| domain adjustments: +/-/arrows/0/1/2, 't' transforms,\n"
         << "| breeding: ctrl-b swap, B stash, b breed, ESC to quit.\n";
 }
@@ -225,7 +290,10 @@ void TreeDemo::showReport(double debounceSeconds)
     }
 
     lastReportTime = curTime;
-    cout << std::setw(8) << curTime << ": " << totalNodesProcessed << " nodes processed (" << ((double)totalNodesProcessed) / curTime << "/s)" << endl;
+    cout << std::setw(8) << curTime << ": " << totalNodesProcessed << " nodes processed (" << ((double)totalNodesProcessed) / curTime << "/s)";
+    if (recorder.isRecording())
+        cout << ", " << recorder.framesWritten() << " frames recorded, " << recorder.framesDropped() << " dropped";
+    cout << endl;
 }
 
 int TreeDemo::openFile(int idx)
@@ -395,7 +463,31 @@ bool TreeDemo::processKey(int key)
     {
     case 'h':           // HD/preview toggle
         renderSize = (renderSize == renderSizePreview ? renderSizeHD : renderSizePreview);
-        restart();
+        redraw();
+        return true;
+
+    case 'E':           // export current model at export resolution ('H' is the legacy up-arrow code)
+        exportImage(renderSizeExport);
+        return true;
+
+    case 'v':           // start/stop time-lapse recording
+        toggleRecording();
+        return true;
+
+    case 'V':           // export current model as SVG
+        exportVector("svg");
+        return true;
+
+    case 'F':           // export current model as PDF ('P' is the legacy down-arrow code)
+        exportVector("pdf");
+        return true;
+
+    case 'G':           // render current model strip by strip to a BigTIFF, at any size
+        exportStrips(renderSizeStrips);
+        return true;
+
+    case 'Z':           // render current model as a zoomable tile pyramid
+        exportTiles(tilePyramidMaxZoom);
         return true;
 
     case 'C':
@@ -481,6 +573,7 @@ bool TreeDemo::processKey(int key)
         return true;
 
     case 'l':   // cycle thru line options
+        endWorkerTask();
         if (pTree->lineThickness == 0)
         {
             pTree->lineThickness = 1;
@@ -494,17 +587,19 @@ bool TreeDemo::processKey(int key)
         {
             pTree->lineThickness = 0;
         }
-        restart();
+        redraw();
         return true;
 
     case 'c':   // randomize colors
+        endWorkerTask();
         pTree->randomizeTransforms(1);
-        restart();
+        recolor();
         return true;
 
     case 'p':   // randomize drawPolygon
+        endWorkerTask();
         pTree->randomizeTransforms(4);
-        restart();
+        redraw();
         return true;
 
     case '.':
@@ -664,8 +759,12 @@ bool TreeDemo::processKey(int key)
     return false;
 }
 
+//  Saves the canvas and settings. Growth is paused meanwhile, so the image and settings match.
 int TreeDemo::save()
 {
+    bool wasRunning = isWorkerTaskRunning();
+    endWorkerTask();
+
     std::unique_lock<std::mutex> lock(demo_mutex);
 
     findNextUnusedFileIndex();
@@ -696,9 +795,195 @@ int TreeDemo::save()
 
     cout << "Image saved: " << imagePath << endl;
 
+    lock.unlock();
+    if (wasRunning)
+        startWorkerTask();
+
     return 0;
 }
 
+//  Renderer for exports, with the export quality settings
+StripRenderer TreeDemo::getExportRenderer() const
+{
+    StripRenderer renderer;
+    renderer.supersampling = exportSupersampling;
+    renderer.linearLight = exportLinearLight;
+    return renderer;
+}
+
+//  Renders the current model at {size} and writes it next to the most recently saved settings,
+//  as "tree%04d.{width}x{height}.png". Growth is paused while rendering, not restarted.
+int TreeDemo::exportImage(cv::Size size)
+{
+    bool wasRunning = isWorkerTaskRunning();
+    endWorkerTask();
+
+    int result = 0;
+    {
+        std::unique_lock<std::mutex> lock(demo_mutex);
+
+        if (currentFileIndex < 0)
+            findNextUnusedFileIndex();
+
+        cv::Mat3b image(size);
+
+        auto t0 = std::chrono::steady_clock::now();
+        if (getExportRenderer().render(*pTree, size, imagePadding, [&](cv::Mat3b const &strip, int y) {
+                strip.copyTo(image(cv::Rect(0, y, strip.cols, strip.rows)));
+            }))
+        {
+            char filename[40];
+            sprintf_s(filename, "tree%04d.%dx%d.png", currentFileIndex, size.width, size.height);
+            cv::imwrite(filename, image);
+
+            double seconds = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - t0).count();
+            cout << "Image exported: " << filename << " (" << seconds << "s)" << endl;
+        }
+        else
+        {
+            cout << "Export not supported: " << pTree->name << " doesn't retain its nodes\n";
+            result = -1;
+        }
+    }
+
+    if (wasRunning)
+        startWorkerTask();
+
+    return result;
+}
+
+//  Writes the current model as vector polygons, framed and styled as the current canvas,
+//  to "tree%04d.{extension}". Nodes are streamed to disk, so this works for any size of tree.
+int TreeDemo::exportVector(char const *extension)
+{
+    bool wasRunning = isWorkerTaskRunning();
+    endWorkerTask();
+
+    int result = 0;
+    {
+        std::unique_lock<std::mutex> lock(demo_mutex);
+
+        if (currentFileIndex < 0)
+            findNextUnusedFileIndex();
+
+        char filename[40];
+        sprintf_s(filename, "tree%04d.%s", currentFileIndex, extension);
+
+        auto t0 = std::chrono::steady_clock::now();
+        if (VectorWriter::exportTree(*pTree, canvas.globalTransform, canvas.image.size(), filename))
+        {
+            double seconds = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - t0).count();
+            cout << "Vector exported: " << filename << " (" << seconds << "s)" << endl;
+        }
+        else
+        {
+            cout << "Vector export failed: " << filename << endl;
+            result = -1;
+        }
+    }
+
+    if (wasRunning)
+        startWorkerTask();
+
+    return result;
+}
+
+//  Renders the current model at {size} in strips streamed to "tree%04d.{width}x{height}.tif",
+//  so memory use doesn't depend on image size. Growth is paused while rendering.
+int TreeDemo::exportStrips(cv::Size size)
+{
+    bool wasRunning = isWorkerTaskRunning();
+    endWorkerTask();
+
+    int result = 0;
+    {
+        std::unique_lock<std::mutex> lock(demo_mutex);
+
+        if (currentFileIndex < 0)
+            findNextUnusedFileIndex();
+
+        char filename[48];
+        sprintf_s(filename, "tree%04d.%dx%d.tif", currentFileIndex, size.width, size.height);
+
+        auto t0 = std::chrono::steady_clock::now();
+        if (getExportRenderer().render(*pTree, size, imagePadding, filename))
+        {
+            double seconds = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - t0).count();
+            cout << "Image exported: " << filename << " (" << seconds << "s)" << endl;
+        }
+        else
+        {
+            cout << "Strip export failed: " << filename << endl;
+            result = -1;
+        }
+    }
+
+    if (wasRunning)
+        startWorkerTask();
+
+    return result;
+}
+
+//  Renders the current model as XYZ tiles, levels 0 to {maxZoom}, into "tree%04d.tiles/".
+//  Growth is paused while rendering.
+int TreeDemo::exportTiles(int maxZoom)
+{
+    bool wasRunning = isWorkerTaskRunning();
+    endWorkerTask();
+
+    int result = 0;
+    {
+        std::unique_lock<std::mutex> lock(demo_mutex);
+
+        if (currentFileIndex < 0)
+            findNextUnusedFileIndex();
+
+        char dirname[40];
+        sprintf_s(dirname, "tree%04d.tiles", currentFileIndex);
+
+        TilePyramid pyramid;
+        pyramid.maxZoom = maxZoom;
+
+        auto t0 = std::chrono::steady_clock::now();
+        if (pyramid.render(*pTree, dirname))
+        {
+            double seconds = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - t0).count();
+            cout << "Tiles exported: " << dirname << ", " << pyramid.tilesWritten << " tiles, " << pyramid.tilesSkipped << " empty skipped (" << seconds << "s)" << endl;
+        }
+        else
+        {
+            cout << "Tile export not supported: " << pTree->name << " doesn't retain its nodes\n";
+            result = -1;
+        }
+    }
+
+    if (wasRunning)
+        startWorkerTask();
+
+    return result;
+}
+
+//  Starts recording growth to "tree%04d.frames/" (or "tree%04d.avi"), or stops the current recording
+void TreeDemo::toggleRecording()
+{
+    if (recorder.isRecording())
+    {
+        recorder.stop();
+        return;
+    }
+
+    if (currentFileIndex < 0)
+        findNextUnusedFileIndex();
+
+    char filename[40];
+    if (recordFormat == FrameRecorder::Format::VIDEO)
+        sprintf_s(filename, "tree%04d.avi", currentFileIndex);
+    else
+        sprintf_s(filename, "tree%04d.frames", currentFileIndex);
+
+    recorder.start(filename, recordFormat);
+}
+
 int TreeDemo::openPrevious()
 {
     findPreviousFile();
@@ -3,6 +3,11 @@
 #include "SelfLimitingPolygonTree.h"
 #include "GridTree.h"
 #include "ReptileTree.h"
+#include "VectorExporter.h"
+#include "SnapshotBuffer.h"
+#include "FrameRecorder.h"
+#include "StripRenderer.h"
+#include "TilePyramid.h"
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc.hpp>
 #include <iostream>
@@ -12,6 +17,7 @@
 #include <chrono>
 #include <future>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
 
 
@@ -25,15 +31,32 @@ class TreeDemo
 public:
     cv::Mat loadedImage;
     qcanvas canvas;
+    // completed frames of canvas.image, for display threads
+    SnapshotBuffer snapshots;
+    // time-lapse capture of canvas.image
+    FrameRecorder recorder;
+    FrameRecorder::Format recordFormat = FrameRecorder::Format::PNG_SEQUENCE;
 
     cv::Size renderSizePreview  = cv::Size(200, 200);
     cv::Size renderSizeHD       = cv::Size(2000, 1500);
+    cv::Size renderSizeExport   = cv::Size(8000, 6000);
+    cv::Size renderSizeStrips   = cv::Size(100000, 75000);  // streamed to disk, so not limited by memory
+    int tilePyramidMaxZoom      = 8;                        // 256px tiles: 65536px across at the deepest level
+
+    // export quality: 'E' and 'G' render in linear light, supersampled, then resolve to 8-bit sRGB
+    int exportSupersampling     = 2;
+    bool exportLinearLight      = true;
     cv::Size renderSize         = renderSizePreview;
 
     ThornTree defaultTree;
     qtree *pTree = nullptr;
     qtree *pBreedTree = nullptr;
 
+    // heap allocations made while processing nodes, on the thread processing them. Counted by a
+    // debug heap hook where the app installs one (the console app's debug build does); otherwise 0
+    static inline std::atomic<size_t> growthAllocations = 0;
+    static inline thread_local bool countingAllocations = false;
+
     int minNodesProcessedPerFrame = 1;
     int maxNodesProcessedPerFrame = 64;
     bool m_stepping = false;
@@ -58,6 +81,7 @@ public:
 
 private:
     std::future<void> s_run;
+    std::vector<cv::Rect> m_dirtyRects;
     bool s_cancel = false;
 
     void processCommands();
@@ -67,22 +91,33 @@ private:
 
     void sendProgressUpdate();
 
+    StripRenderer getExportRenderer() const;
+
 public:
     bool isWorkerTaskRunning() const;
 
     std::condition_variable cv;
-    std::function<int(int, int)> m_progressCallback;
+    // called after each frame is published, with the regions of canvas.image drawn since the previous call
+    std::function<int(int, int, std::vector<cv::Rect> const &)> m_progressCallback;
 
     bool beginStepMode();
     bool endStepMode();
 
     void restart(bool randomize=false);
+    void redraw();
+    void recolor();
+    int removeNodes(cv::Rect2f const &modelRect);
 
     int processNodes();
 
     bool processKey(int key);
 
     int save();
+    int exportImage(cv::Size size);
+    int exportVector(char const *extension);
+    void toggleRecording();
+    int exportStrips(cv::Size size);
+    int exportTiles(int maxZoom);
     int openNext();
     int openPrevious();
     int openFile(int idx);
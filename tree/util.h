@@ -4,8 +4,14 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/core/affine.hpp>
+#include <opencv2/core/utility.hpp>
 #include <vector>
 #include <string>
+#include <cstdint>
+#include <cfloat>
+#include <algorithm>
+#include <cmath>
+#include <utility>
 
 
 // Operators for OpenCV types
@@ -46,35 +52,63 @@ namespace util
         }
 
 
-        template<typename _Tp>
-        cv::Mat_<_Tp> getRotationMatrix2D(cv::Point_<_Tp> center, double angle, double scale, _Tp translateX = 0, _Tp translateY = 0)
+        //  cos and sin of {angle} degrees: {cos, sin}. Exact at multiples of 90 degrees.
+        //  constexpr, so builders given a literal angle can be evaluated at compile time
+        constexpr std::pair<double, double> cosSinDegrees(double angle)
         {
-            cv::Mat_<_Tp> m = cv::Mat_<_Tp>::eye(3, 3);
-            m(cv::Range(0, 2), cv::Range::all()) = cv::getRotationMatrix2D(center, angle, scale);
-            m.at<_Tp>(0, 2) += translateX;
-            m.at<_Tp>(1, 2) += translateY;
-            return m;
+            // reduce to a quadrant and a remainder within 45 degrees, then a short series
+            long long quadrant = (long long)(angle / 90.0 + (angle < 0.0 ? -0.5 : 0.5));
+            double x = (angle - 90.0 * (double)quadrant) * (CV_PI / 180.0);
+            double x2 = x * x;
+            double s = x, c = 1.0, ts = x, tc = 1.0;
+            for (int k = 1; k <= 10; ++k)
+            {
+                ts *= -x2 / ((2 * k) * (2 * k + 1));
+                tc *= -x2 / ((2 * k - 1) * (2 * k));
+                s += ts;
+                c += tc;
+            }
+            switch (((quadrant % 4) + 4) % 4)
+            {
+            case 1:  return { -s, c };
+            case 2:  return { -c, -s };
+            case 3:  return { s, -c };
+            default: return { c, s };
+            }
         }
 
+        //  As cv::getRotationMatrix2D (counterclockwise in y-down image coords), in 3x3 form, plus a translation
         template<typename _Tp>
-        cv::Mat_<_Tp> getFlipScaleOffset(double scale, double offX, double offY)
+        cv::Matx<_Tp, 3, 3> getRotationMatrix2D(cv::Point_<_Tp> center, double angle, double scale, _Tp translateX = 0, _Tp translateY = 0)
         {
-            return (cv::Mat_<_Tp>(3, 3) <<
-                scale, 0, offX,
-                0, -scale, offY,
+            auto cs = cosSinDegrees(angle);
+            double alpha = cs.first * scale;
+            double beta = cs.second * scale;
+            return cv::Matx<_Tp, 3, 3>(
+                (_Tp)alpha, (_Tp)beta, (_Tp)((1 - alpha) * center.x - beta * center.y + translateX),
+                (_Tp)-beta, (_Tp)alpha, (_Tp)(beta * center.x + (1 - alpha) * center.y + translateY),
                 0, 0, 1);
         }
 
         template<typename _Tp>
-        cv::Mat_<_Tp> getRotateFlipScaleOffset(double angle, double scale, double offX, double offY)
+        cv::Matx<_Tp, 3, 3> getFlipScaleOffset(double scale, double offX, double offY)
         {
-            cv::Mat_<_Tp> m = cv::Mat_<_Tp>::eye(3, 3);
-            m(cv::Range(0, 2), cv::Range::all()) = cv::getRotationMatrix2D(cv::Point_<_Tp>(1.0, 0.0), angle, scale);
+            return cv::Matx<_Tp, 3, 3>(
+                (_Tp)scale, 0, (_Tp)offX,
+                0, (_Tp)-scale, (_Tp)offY,
+                0, 0, 1);
+        }
 
-            m.at<_Tp>(1, 1) = -m.at<_Tp>(1, 1);
-            m.at<_Tp>(0, 2) = offX;
-            m.at<_Tp>(1, 2) = offY;
-            return m;
+        template<typename _Tp>
+        cv::Matx<_Tp, 3, 3> getRotateFlipScaleOffset(double angle, double scale, double offX, double offY)
+        {
+            auto cs = cosSinDegrees(angle);
+            double alpha = cs.first * scale;
+            double beta = cs.second * scale;
+            return cv::Matx<_Tp, 3, 3>(
+                (_Tp)alpha, (_Tp)beta, (_Tp)offX,
+                (_Tp)-beta, (_Tp)-alpha, (_Tp)offY,
+                0, 0, 1);
         }
 
         // Matx
@@ -177,6 +211,15 @@ namespace util
         return (max < epsilon);
     }
 
+    //  mixes {v} into running hash {h} (splitmix64 finalizer)
+    inline uint64_t hashCombine(uint64_t h, uint64_t v)
+    {
+        uint64_t z = h ^ (v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2));
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
     template<typename _Tp>
     cv::Rect_<_Tp> getBoundingRect(std::vector<cv::Point_<_Tp> > const &pts)
     {
@@ -207,6 +250,38 @@ namespace util
         return rect;
     }
 
+    //  Adds {rc} to a list of regions, merging it into any region it overlaps or touches.
+    //  Past {maxRects} regions, the list collapses to their single bounding rect.
+    inline void addRegion(std::vector<cv::Rect> &rects, cv::Rect rc, size_t maxRects = 32)
+    {
+        if (rc.empty())
+            return;
+
+        for (size_t i = 0; i < rects.size(); )
+        {
+            cv::Rect const &r = rects[i];
+            if (rc.x <= r.x + r.width && r.x <= rc.x + rc.width && rc.y <= r.y + r.height && r.y <= rc.y + rc.height)
+            {
+                // merged rect may now reach others: take it out and keep scanning
+                rc |= r;
+                rects[i] = rects.back();
+                rects.pop_back();
+                i = 0;
+            }
+            else
+            {
+                ++i;
+            }
+        }
+        rects.push_back(rc);
+
+        if (rects.size() > maxRects)
+        {
+            for (auto const &r : rects)
+                rc |= r;
+            rects.assign(1, rc);
+        }
+    }
 
 
     //  Assumes provided Scalar is in BGR order and scaled 0..255; returns string as "RRGGBB"
@@ -322,6 +397,76 @@ namespace util
         return (mat(0, 0));
     }
 
+#pragma endregion
+
+#pragma region HLS
+
+    //  Closed-form float BGR <-> HLS, matching cv::cvtColor on CV_32F data (COLOR_BGR2HLS / COLOR_HLS2BGR)
+    //  without building a Mat per call.
+    //  h: 0.0-360.0; l: 0.0-1.0; s: 0.0-1.0. Nothing is clamped, as with cvtColor.
+
+    inline cv::Vec3f bgr2hls(float b, float g, float r)
+    {
+        float vmax = std::max(std::max(r, g), b);
+        float vmin = std::min(std::min(r, g), b);
+        float diff = vmax - vmin;
+        float h = 0.0f, s = 0.0f;
+        float l = (vmax + vmin) * 0.5f;
+
+        if (diff > FLT_EPSILON)
+        {
+            s = (l < 0.5f) ? diff / (vmax + vmin) : diff / (2.0f - vmax - vmin);
+            diff = 60.0f / diff;
+
+            if (vmax == r)
+                h = (g - b) * diff;
+            else if (vmax == g)
+                h = (b - r) * diff + 120.0f;
+            else
+                h = (r - g) * diff + 240.0f;
+
+            if (h < 0.0f)
+                h += 360.0f;
+        }
+        return cv::Vec3f(h, l, s);
+    }
+
+    inline cv::Vec3f hls2bgr(float h, float l, float s)
+    {
+        if (s == 0.0f)
+            return cv::Vec3f(l, l, l);
+
+        static int const sectorData[6][3] = { { 1, 3, 0 }, { 1, 0, 2 }, { 3, 0, 1 }, { 0, 2, 1 }, { 0, 1, 3 }, { 2, 1, 0 } };
+
+        float p2 = (l <= 0.5f) ? l * (1.0f + s) : l + s - l * s;
+        float p1 = 2.0f * l - p2;
+
+        h *= 6.0f / 360.0f;
+        if (h < 0.0f)
+            do h += 6.0f; while (h < 0.0f);
+        else if (h >= 6.0f)
+            do h -= 6.0f; while (h >= 6.0f);
+
+        int sector = cvFloor(h);
+        h -= sector;
+
+        float tab[4] = { p2, p1, p1 + (p2 - p1) * (1.0f - h), p1 + (p2 - p1) * h };
+        return cv::Vec3f(tab[sectorData[sector][0]], tab[sectorData[sector][1]], tab[sectorData[sector][2]]);
+    }
+
+    //  Scalar forms, as util::cvtColor returns them: 4th element is 1, for use as homogeneous coordinates
+    inline cv::Scalar bgr2hls(cv::Scalar const &bgr)
+    {
+        cv::Vec3f v = bgr2hls((float)bgr(0), (float)bgr(1), (float)bgr(2));
+        return cv::Scalar(v[0], v[1], v[2], 1.0);
+    }
+
+    inline cv::Scalar hls2bgr(cv::Scalar const &hls)
+    {
+        cv::Vec3f v = hls2bgr((float)hls(0), (float)hls(1), (float)hls(2));
+        return cv::Scalar(v[0], v[1], v[2], 1.0);
+    }
+
 #pragma endregion
 
     template<class _Class>
@@ -330,6 +475,38 @@ namespace util
         container = _Class();
     }
 
+    //  Underlying container of a container adaptor such as std::priority_queue,
+    //  for in-place updates that don't affect ordering
+    template<class _Adaptor>
+    typename _Adaptor::container_type &container(_Adaptor &adaptor)
+    {
+        struct Access : _Adaptor
+        {
+            static typename _Adaptor::container_type &get(_Adaptor &a) { return a.*(&Access::c); }
+        };
+        return Access::get(adaptor);
+    }
+
+    //  Runs fn(i) for i in [0, n) on OpenCV's thread pool.
+    //  (OpenCV 3.1's parallel_for_ has no lambda overload.)
+    template<class _Fn>
+    void parallelFor(int n, _Fn const &fn)
+    {
+        class Body : public cv::ParallelLoopBody
+        {
+            _Fn const &m_fn;
+        public:
+            Body(_Fn const &fn) : m_fn(fn) {}
+            virtual void operator()(cv::Range const &range) const override
+            {
+                for (int i = range.start; i < range.end; ++i)
+                    m_fn(i);
+            }
+        };
+
+        cv::parallel_for_(cv::Range(0, n), Body(fn));
+    }
+
     namespace polygon
     {
         template<typename _Tp>
@@ -341,6 +518,22 @@ namespace util
             return sum / (_Tp)polygon.size();
         }
 
+        //  maps polygon points through the affine part of a 3x3 transform.
+        //  {dst} is resized, not reallocated, so callers that keep a scratch vector don't touch the heap.
+        //  {dst} may alias {src}.
+        template<typename _Tp>
+        void transform(std::vector<cv::Point_<_Tp> > const &src, std::vector<cv::Point_<_Tp> > &dst, cv::Matx<_Tp, 3, 3> const &m)
+        {
+            dst.resize(src.size());
+            for (size_t i = 0; i < src.size(); ++i)
+            {
+                cv::Point_<_Tp> const p = src[i];
+                dst[i] = cv::Point_<_Tp>(
+                    m(0, 0) * p.x + m(0, 1) * p.y + m(0, 2),
+                    m(1, 0) * p.x + m(1, 1) * p.y + m(1, 2));
+            }
+        }
+
         template<typename _Tp>
         cv::Point_<_Tp> headingStep(_Tp angleDegrees)
         {
@@ -361,32 +554,54 @@ namespace util
             }
         }
 
+        //  Path of unit steps at {headingsDegrees} from (0,0): the start, then the point after each step.
+        //  Each point is summed in double from exact headings and rounded once, so points don't accumulate
+        //  float rounding, and polygons built from paths close to within a rounding of their start.
+        template<typename _Tp>
+        void createHeadingPath(std::vector<cv::Point_<_Tp> > &path, std::vector<double> const &headingsDegrees)
+        {
+            path.clear();
+            double x = 0.0, y = 0.0;
+            path.push_back(cv::Point_<_Tp>(0, 0));
+            for (double h : headingsDegrees)
+            {
+                auto cs = transform3x3::cosSinDegrees(h);
+                x += cs.first;
+                y += cs.second;
+                path.push_back(cv::Point_<_Tp>((_Tp)x, (_Tp)y));
+            }
+        }
+
         //  creates regular polygon with side length 1 and first edge from (0,0) to (1,0)
         template<typename _Tp>
         void createRegularPolygon(std::vector<cv::Point_<_Tp> > &polygon, int polygonSides)
         {
-            polygon.clear();
-            cv::Point_<_Tp> pt(0, 0);
+            std::vector<double> headings(polygonSides);
             for (int i = 0; i < polygonSides; i++)
-            {
-                polygon.push_back(pt);
-                pt += headingStep((_Tp)(i * 360.0 / polygonSides));
-            }
+                headings[i] = i * 360.0 / polygonSides;
+
+            // the last step returns to the start
+            createHeadingPath(polygon, headings);
+            polygon.pop_back();
         }
 
         //  creates regular star with {n} points of angle {a} and side length 1
         template<typename _Tp>
         void createStar(std::vector<cv::Point_<_Tp> > &polygon, int n, float a)
         {
-            polygon.clear();
-            cv::Point2f pt(0, 0);
-            _Tp hdg = 0.0f;
-            a = 180.0f - a;
+            // turn by 180 - {a} into each point, and back out by that less 360/{n}
+            std::vector<double> headings(2 * n);
+            double turn = 180.0 - a;
             for (int i = 0; i < n; ++i)
             {
-                polygon.push_back(pt += headingStep(hdg += a));
-                polygon.push_back(pt += headingStep(hdg += (360.0f / n - a)));
+                headings[2 * i] = i * 360.0 / n + turn;
+                headings[2 * i + 1] = (i + 1) * 360.0 / n;
             }
+
+            // vertices start after the first step, and end at the start
+            createHeadingPath(polygon, headings);
+            polygon.erase(polygon.begin());
+            polygon.back() = cv::Point_<_Tp>(0, 0);
         }
 
         //  creates regular 5-pointed star with side length 1